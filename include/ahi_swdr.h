@@ -1,25 +1,117 @@
 #pragma once
 
 #include "read_config_file.h"
+#include "lut_store.h"
 #include <string>
+#include <memory>
+#include <ostream>
 #include <armadillo>
 
+// Valid pixels of an image grouped by retrieval cell. A cell lies between two SZA, VZA and DEM nodes
+// (both included) around the nearest LOS node; a pixel on a node shared by two cells is grouped into
+// the last one only (see bin_pixels); its key is ((sza * n_vza + vza) * n_los + los) * n_dem + dem over the lower node indices.
+struct PixelBins
+{
+	arma::uword n_sza = 0;
+	arma::uword n_vza = 0;
+	arma::uword n_los = 0;
+	arma::uword n_dem = 0;
+
+	arma::uvec cells;                    // keys of the occupied cells, ascending
+	arma::uvec cell_start;               // pixels of cells(ic): pixels[cell_start(ic), cell_start(ic + 1))
+	arma::uvec pixels;                   // indices into the valid pixels, ascending inside a cell
+
+	// valid pixels of each SZA/VZA cell, of each SZA/VZA/LOS cell and of each cell (by key), a pixel on
+	// a node counted in the cells on both sides, for the minimum pixel checks
+	arma::uvec sza_vza_count;
+	arma::uvec los_count;
+	arma::uvec cell_count;
+};
+
+// Valid pixels of the cells over a whole image and the SZA/VZA nodes around them; the strips
+// of an image are binned and retrieved with these, so the minimum pixel checks of a cell
+// do not depend on the strip height
+struct ImageCells
+{
+	arma::uword nvalid = 0;
+	float sza_min = 0;
+	float sza_max = 0;
+	float vza_min = 0;
+	float vza_max = 0;
+
+	arma::uword dw_sza_idx = 0;
+	arma::uword up_sza_idx = 0;
+	arma::uword dw_vza_idx = 0;
+	arma::uword up_vza_idx = 0;
+
+	arma::uword n_sza = 0;               // as in PixelBins
+	arma::uword n_vza = 0;
+	arma::uword n_los = 0;
+	arma::uword n_dem = 0;
+	arma::uvec sza_vza_count;
+	arma::uvec los_count;
+	arma::uvec cell_count;               // by cell key
+};
+
+// Nodes of a retrieval cell, passed to get_SWDR and interp_dem
+// so that the cells of an image can be retrieved concurrently
+struct CellContext
+{
+	arma::uword dw_sza;
+	arma::uword up_sza;
+	arma::uword dw_vza;
+	arma::uword up_vza;
+	float los;                           // the nearest LOS node
+	float dw_dem;
+	float up_dem;
+};
+
+// LUT rows of the cells of one get_SWDR call (one cell, or a batch of small cells), decoded out of
+// the LUT store once and then read by every get_SWDR call on them (no-snow classes and all the
+// snow NDSI windows); the pixels of a call give the cell of each pixel as a slice index
+struct PreparedCellLut
+{
+	std::vector<CellContext> cells;
+	arma::fcube quantities;              // slice c = cell c, column q = quantity q (LutQuantity), decoded to float
+};
+
 class ahi_swdr
 {
 public:
-	ahi_swdr(const myConfig& cfg);
+	explicit ahi_swdr(const myConfig& cfg, std::shared_ptr<const LutStore> lut = nullptr);
+	// lut_nodes[node]: the LUT copy of each NUMA node (lut_numa = replicate), a single shared copy otherwise
+	ahi_swdr(const myConfig& cfg, const std::vector<std::shared_ptr<const LutStore>>& lut_nodes);
 	~ahi_swdr();
 	int sequential_run(const std::string& input_path, const std::string& output_path);
 
 	int batch_run_tbb(const myConfig& cfg, const std::string& input_path, const std::string& output_path);
 	int retrieve_image(const std::string& input_file, const std::string& out_file);
+	// plan of the scenes of input_path, written to plan_file as JSON, without any retrieval
+	int plan_run(const myConfig& cfg, const std::string& input_path, const std::string& plan_file);
 	//int retrieve_txt(const std::string& input_file, const std::string& out_file);
 
 private:
 
 	//void smooth_flux(arma::fmat& flux) const;
 
-	int read_lut(const std::string& lut_file, const arma::uword& lut_cols);
+	int check_lut() const;
+	// add the valid pixels of the image strip data (bands up to the band 7 radiance at least) to cells
+	void count_cells(const arma::fcube& data, ImageCells& cells) const;
+	// SZA/VZA nodes of the image once all its strips are counted
+	int locate_cells(ImageCells& cells) const;
+	// first LUT rows of the SZA/VZA nodes of the image, idx_filter_vza rows each
+	arma::uvec node_rows(const ImageCells& cells) const;
+	// the cell key has at least 5 pixels of the image in its SZA/VZA cell, in its LOS cell and in itself
+	bool cell_retrieved(const ImageCells& cells, arma::uword key) const;
+	// get_SWDR calls of the cells keys(order) (largest first): one per cell, the cells with fewer than
+	// cell_batch_pixels pixels together; a task holds indices into keys
+	void batch_cells(const arma::uvec& keys, const arma::uvec& sizes, const arma::uvec& order,
+		std::vector<arma::uvec>& tasks) const;
+	// cells, LUT rows, tile bytes and CPU time of one scene as a JSON object; threads concurrent
+	// get_SWDR calls, row_cost_ns CPU time per pixel and LUT row
+	int plan_image(const std::string& input_file, arma::uword threads, double row_cost_ns, std::ostream& json) const;
+	// retrieve the image strip data, released on the way, into the bands of the output file
+	int retrieve_strip(arma::fcube& data, const ImageCells& cells, arma::Cube<short>& fluxes) const;
 	//int read_input_file(const std::string& input_file);
 
 	//int save_result_file(const std::string& out_file, const arma::fmat& data);
@@ -34,39 +126,63 @@ private:
 
 
 	//int filter_lut(arma::fmat& lut, arma::fmat& lut_new);
-	int filter_sza(float sza_min, float sza_max, arma::uword& up_sza_idx, arma::uword& dw_sza_idx, const arma::fvec& angle_list, arma::uword m_angle_min, arma::uword m_angle_max);
+	int filter_sza(float sza_min, float sza_max, arma::uword& up_sza_idx, arma::uword& dw_sza_idx, const arma::fvec& angle_list, arma::uword m_angle_min, arma::uword m_angle_max) const;
+	// counting sort of the valid pixels (flag 1) with positive band 6/7 radiance into the cells,
+	// SZA cells [sza_st, sza_ed) and VZA cells [vza_st, vza_ed) only; a pixel in several cells goes to the
+	// one of largest key, among those retrieved (cell_retrieved) unless retrieved is nullptr
+	void bin_pixels(const arma::fvec& sza_v, const arma::fvec& vza_v, const arma::fvec& los_v, const arma::fvec& dem_v,
+		const arma::fvec& toa_rad_b6_v, const arma::fvec& toa_rad_b7_v,
+		arma::uword sza_st, arma::uword sza_ed, arma::uword vza_st, arma::uword vza_ed, const ImageCells* retrieved,
+		PixelBins& bins) const;
+	// the LUT copy of the NUMA node the calling thread runs on, m_lut without replicas
+	const LutStore& local_lut() const;
+	// nodes and LUT rows of the cells bins.cells(ic) of every ic of cells, 1 if the LUT rows cannot be read
+	int prepare_cell_lut(const PixelBins& bins, const arma::uvec& cells, PreparedCellLut& lut) const;
 	// arma::fmat par_lut_tile, arma::fvec dir_par_lut_tile, arma::fmat uva_lut_tile,
 	//arma::fvec dir_uva_lut_tile, arma::fmat uvb_lut_tile, arma::fvec dir_uvb_lut_tile, arma::fmat toa_up_flux_lut_tile,
-	int interp_dem(arma::fvec& dem_sub_v, arma::fvec& toa_rad_b1_sub_v, arma::fvec& toa_rad_b3_sub_v, arma::fvec& toa_rad_b6_sub_v, arma::fvec& toa_rad_b7_sub_v,
-		arma::fmat toa_rad_band1_lut_tile, arma::fmat toa_rad_band3_lut_tile, arma::fmat toa_rad_band6_lut_tile, arma::fmat toa_rad_band7_lut_tile,
-		arma::fmat toa_rad_band1_lut_clear_tile, arma::fmat toa_rad_band3_lut_clear_tile, arma::fmat toa_rad_band6_lut_clear_tile, arma::fmat toa_rad_band7_lut_clear_tile,
-		arma::fmat toa_rad_band1_lut_cloudy_tile, arma::fmat& toa_rad_band3_lut_cloudy_tile, arma::fmat toa_rad_band7_lut_cloudy_tile,
-		arma::fmat toa_rad_ndsi_lut_tile, float lut_diff_max, float lut_diff_min,
+	int interp_dem(const PreparedCellLut& lut, const arma::uvec& pixel_cell, arma::fvec& dem_sub_v, arma::fvec& toa_rad_b1_sub_v, arma::fvec& toa_rad_b3_sub_v, arma::fvec& toa_rad_b6_sub_v, arma::fvec& toa_rad_b7_sub_v,
+		const arma::fmat& toa_rad_band1_lut_tile, const arma::fmat& toa_rad_band3_lut_tile, const arma::fmat& toa_rad_band6_lut_tile, const arma::fmat& toa_rad_band7_lut_tile,
+		const arma::fmat& toa_rad_band1_lut_clear_tile, const arma::fmat& toa_rad_band3_lut_clear_tile, const arma::fmat& toa_rad_band6_lut_clear_tile, const arma::fmat& toa_rad_band7_lut_clear_tile,
+		const arma::fmat& toa_rad_band1_lut_cloudy_tile, const arma::fmat& toa_rad_band3_lut_cloudy_tile, const arma::fmat& toa_rad_band7_lut_cloudy_tile,
+		const arma::fmat& toa_rad_ndsi_lut_tile, const arma::fvec& lut_diff_max, const arma::fvec& lut_diff_min,
 		arma::uword& idx_up_dem, arma::uword& idx_dw_dem,
-		arma::fmat swdr_lut_tile, arma::fvec swdr_dir_lut_tile, arma::fmat par_lut_tile, arma::fvec dir_par_lut_tile, arma::fmat uva_lut_tile,
-		arma::fmat uvb_lut_tile, arma::fmat toa_up_flux_lut_tile,
-		arma::fvec& COD, const arma::fvec& f_rho, arma::fvec& ref_mean_sub_v, arma::fvec& ref_band1_sub_v, arma::fvec& ref_band3_sub_v, arma::fvec& ref_band6_sub_v, arma::fvec& ref_band7_sub_v, arma::fvec& sza_sub_v,
+		const arma::fvec& sw_albedo_sub_v, const arma::fvec& vis_albedo_sub_v, arma::fvec& ref_mean_sub_v, arma::fvec& ref_band1_sub_v, arma::fvec& ref_band3_sub_v, arma::fvec& ref_band6_sub_v, arma::fvec& ref_band7_sub_v, arma::fvec& sza_sub_v,
 		arma::fvec& itp_swdr, arma::fvec& itp_swdir, arma::fvec& itp_par, arma::fvec& itp_pardir,
 		arma::fvec& itp_uva, arma::fvec& itp_uvb, arma::fvec& itp_toa_up_flux, arma::fvec& itp_rho) const;
 
 
-	int get_SWDR(arma::fmat lut, arma::fvec& sza_sub_v, arma::fvec& vza_sub_v, arma::fvec& dem_sub_v,
+	// the pixels in chunks of chunk_pixels(rows of lut) pixels, one get_SWDR_chunk call each; 1 if a chunk fails
+	int get_SWDR(const PreparedCellLut& lut, const arma::uvec& pixel_cell, arma::fvec& sza_sub_v, arma::fvec& vza_sub_v, arma::fvec& dem_sub_v,
 		arma::fvec& toa_rad_b1_sub_v, arma::fvec& toa_rad_b3_sub_v, arma::fvec& toa_rad_b4_sub_v,
 		arma::fvec& toa_rad_b6_sub_v, arma::fvec& toa_rad_b7_sub_v,
 		arma::fvec& band1_ref_sub_v, arma::fvec& band3_ref_sub_v, arma::fvec& band4_ref_sub_v,
 		arma::fvec& band6_ref_sub_v, arma::fvec& band7_ref_sub_v, arma::fvec& sw_albedo_sub_v, arma::fvec& vis_albedo_sub_v,
-		float lut_diff_max, float lut_diff_min,
+		const arma::fvec& lut_diff_max, const arma::fvec& lut_diff_min,
 		arma::fvec& derived_swdr, arma::fvec& derived_dir, arma::fvec& derived_par, arma::fvec& derived_pardir,
 		arma::fvec& derived_uva, arma::fvec& derived_uvb, 
-		arma::fvec& derived_toa_up_flux, arma::fvec& derived_rho);
+		arma::fvec& derived_toa_up_flux, arma::fvec& derived_rho) const;
+	int get_SWDR_chunk(const PreparedCellLut& lut, const arma::uvec& pixel_cell, arma::fvec& sza_sub_v, arma::fvec& vza_sub_v, arma::fvec& dem_sub_v,
+		arma::fvec& toa_rad_b1_sub_v, arma::fvec& toa_rad_b3_sub_v, arma::fvec& toa_rad_b4_sub_v,
+		arma::fvec& toa_rad_b6_sub_v, arma::fvec& toa_rad_b7_sub_v,
+		arma::fvec& band1_ref_sub_v, arma::fvec& band3_ref_sub_v, arma::fvec& band4_ref_sub_v,
+		arma::fvec& band6_ref_sub_v, arma::fvec& band7_ref_sub_v, arma::fvec& sw_albedo_sub_v, arma::fvec& vis_albedo_sub_v,
+		const arma::fvec& lut_diff_max, const arma::fvec& lut_diff_min,
+		arma::fvec& derived_swdr, arma::fvec& derived_dir, arma::fvec& derived_par, arma::fvec& derived_pardir,
+		arma::fvec& derived_uva, arma::fvec& derived_uvb,
+		arma::fvec& derived_toa_up_flux, arma::fvec& derived_rho) const;
+	// pixels of a get_SWDR chunk whose tiles over lut_rows LUT rows fit in max_tile_bytes, at least 1;
+	// all of them (the largest uword) if max_tile_bytes is 0
+	arma::uword chunk_pixels(arma::uword lut_rows) const;
 
 	int classify_atmos(
 		arma::fmat& toa_rad_band1_lut, arma::fmat& toa_rad_band3_lut, arma::fmat& toa_rad_band6_lut, arma::fmat& toa_rad_band7_lut,
 		arma::fmat& toa_rad_band1_lut_clear, arma::fmat& toa_rad_band3_lut_clear, arma::fmat& toa_rad_band6_lut_clear, arma::fmat& toa_rad_band7_lut_clear,
-		arma::fmat& toa_rad_band1_lut_cloudy, arma::fmat& toa_rad_band3_lut_cloudy, arma::fmat& toa_rad_band7_lut_cloudy);
+		arma::fmat& toa_rad_band1_lut_cloudy, arma::fmat& toa_rad_band3_lut_cloudy, arma::fmat& toa_rad_band7_lut_cloudy) const;
 
 	const std::string m_lut_file;
-	arma::fmat m_lut;
+	std::shared_ptr<const LutStore> m_lut;
+	//lut_numa = replicate: the copy of each NUMA node, m_lut_nodes[node]
+	std::vector<std::shared_ptr<const LutStore>> m_lut_nodes;
 	arma::fmat m_input_records;
 
 	const int m_toa_avg_num;
@@ -74,34 +190,31 @@ private:
 	const int m_ref_bin_num;
 	const float m_f_std;
 	const int m_window;
-
-	const arma::uvec m_sza_list;
-	const arma::fvec m_sza_list_ft;
+	//cells with fewer pixels are retrieved together, up to this many pixels per call; 0 = one call per cell
+	const arma::uword m_cell_batch_pixels;
+	//rows of an image strip read, retrieved and written at a time; 0 = the whole image at once
+	const arma::uword m_strip_rows;
+	//bytes of the tiles of a get_SWDR call, the pixels are split into chunks within it; 0 = no limit
+	const arma::uword m_max_tile_bytes;
+
+	//axis lists of the LUT
+	arma::uvec m_sza_list;
+	arma::fvec m_sza_list_ft;
 	arma::uword m_sza_min;
 	arma::uword m_sza_max;
 
-	const arma::uvec m_vza_list;
-	const arma::fvec m_vza_list_ft;
+	arma::uvec m_vza_list;
+	arma::fvec m_vza_list_ft;
 	arma::uword m_vza_min;
 	arma::uword m_vza_max;
 
-	const arma::fvec m_dem_list;
+	arma::fvec m_dem_list;
 	// const arma::fvec m_dem_list_ft;
 	float m_min_dem;
 	float m_max_dem;
 
-	const arma::uvec m_los_list;
-	const arma::fvec m_los_list_ft;
-
-	arma::uword m_up_sza;
-	arma::uword m_dw_sza;
-	arma::uword m_up_vza;
-	arma::uword m_dw_vza;
-	float m_up_dem = 0;
-	float m_dw_dem = 0;
-	arma::uword m_up_dem10;
-	arma::uword m_dw_dem10;
-	arma::uword m_min_los;
+	arma::uvec m_los_list;
+	arma::fvec m_los_list_ft;
 
 	//LUT˲
 	arma::uword idx_filter_sza;
@@ -109,5 +222,8 @@ private:
 	arma::uword idx_filter_los;
 	arma::uword idx_filter_dem;
 
-	arma::uword lut_cols;
+	//rows of the clear and cloudy atmosphere inside a LUT block
+	arma::uword idx_clear_st;
+	arma::uword idx_clear_ed;
+	arma::uvec idx_cloudy;
 };
\ No newline at end of file
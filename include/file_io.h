@@ -5,6 +5,7 @@
 #include <string>
 #include <vector>
 
+class GDALDataset;
 
 class imageGeoInfo
 {
@@ -19,6 +20,49 @@ private:
 	double geoTrans[6]{};
 };
 
+// rows of an image read strip by strip, the file stays open between the strips
+class imageStripReader
+{
+public:
+	imageStripReader() = default;
+	~imageStripReader();
+	imageStripReader(const imageStripReader&) = delete;
+	imageStripReader& operator=(const imageStripReader&) = delete;
+
+	int open(const std::string& filename);
+	// rows [row_st, row_st + nrows) of the first nbands bands, all the bands for nbands = 0
+	int read_rows(int row_st, int nrows, int nbands, arma::fcube& data) const;
+
+	int n_rows() const { return m_nrows; }
+	int n_cols() const { return m_ncols; }
+	int n_bands() const { return m_nbands; }
+
+private:
+	GDALDataset* m_dataset = nullptr;
+	int m_nrows = 0;
+	int m_ncols = 0;
+	int m_nbands = 0;
+};
+
+// Int16 GeoTIFF written strip by strip, -1 for no data
+class imageStripWriter
+{
+public:
+	imageStripWriter() = default;
+	~imageStripWriter();
+	imageStripWriter(const imageStripWriter&) = delete;
+	imageStripWriter& operator=(const imageStripWriter&) = delete;
+
+	int open(const std::string& out_fn, int nrows, int ncols, int nbands, const imageGeoInfo& geoinfo);
+	// rows [row_st, row_st + data.n_rows) of all the bands
+	int write_rows(int row_st, const arma::Cube<short>& data);
+	// flush the file to disk, 1 on failure
+	int close();
+
+private:
+	GDALDataset* m_dataset = nullptr;
+};
+
 int glob_filelist(const std::string& in_path, std::string ext_name,
 	std::vector<std::string>& filelist);
 int read_3d_geotif(const std::string& filename, arma::fcube& data);
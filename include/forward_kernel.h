@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Forward model of the matching bands over the LUT rows of one cell for one pixel:
+// TOA radiance i0 + cplx / (1 / ref - rho) of bands 1, 3, 4, 6 and 7 and the NDSI of bands 4/6,
+// all in one pass over the rows.
+enum ForwardBand
+{
+	FWD_B1 = 0,
+	FWD_B3,
+	FWD_B4,
+	FWD_B6,
+	FWD_B7,
+	FWD_BAND_NUM
+};
+
+// outputs of forward_bands: the radiances except band 4, which only enters the NDSI
+enum ForwardOutput
+{
+	FWD_OUT_B1 = 0,
+	FWD_OUT_B3,
+	FWD_OUT_B6,
+	FWD_OUT_B7,
+	FWD_OUT_NDSI,
+	FWD_OUT_NUM
+};
+
+// LUT columns (nrows values each) of the cell of the pixel
+struct ForwardColumns
+{
+	const float* i0[FWD_BAND_NUM];
+	const float* rho[FWD_BAND_NUM];
+	const float* cplx[FWD_BAND_NUM];
+};
+
+// inv_ref: 1 / surface reflectance of the pixel per band; out: nrows values per output.
+// The operations are those of the Armadillo expressions they replace, in the same order,
+// so every instruction set gives the same values.
+void forward_bands(const ForwardColumns& lut, const float inv_ref[FWD_BAND_NUM], size_t nrows,
+	float* const out[FWD_OUT_NUM]);
+
+// instruction set of forward_bands on this CPU: avx512, avx2 or scalar
+const char* forward_kernel_name();
+
+// use the instruction set isa (avx512, avx2 or scalar) from now on, e.g. to compare them;
+// 1 if the CPU lacks it. Not to be called while forward_bands runs.
+int forward_kernel_select(const std::string& isa);
@@ -0,0 +1,203 @@
+#pragma once
+
+#include "read_config_file.h"
+
+#include <armadillo>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Axes of the LUT, from the outermost to the innermost node
+enum LutAxis
+{
+	LUT_AXIS_SZA = 0,
+	LUT_AXIS_VZA,
+	LUT_AXIS_LOS,
+	LUT_AXIS_DEM,
+	LUT_AXIS_NUM
+};
+
+// Quantities kept in the binary LUT, the axis columns (sza, vza, los, dem) of the text LUT are dropped
+// and the direct + diffuse columns of each flux product are stored as one f0
+enum LutQuantity
+{
+	LUT_Q_COD = 0,
+	LUT_Q_I0_B1, LUT_Q_RHO_B1, LUT_Q_CPLX_B1,
+	LUT_Q_I0_B3, LUT_Q_RHO_B3, LUT_Q_CPLX_B3,
+	LUT_Q_I0_B4, LUT_Q_RHO_B4, LUT_Q_CPLX_B4,
+	LUT_Q_I0_B6, LUT_Q_RHO_B6, LUT_Q_CPLX_B6,
+	LUT_Q_I0_B7, LUT_Q_RHO_B7, LUT_Q_CPLX_B7,
+	LUT_Q_SW_F0, LUT_Q_SW_DIR, LUT_Q_SW_RHO, LUT_Q_SW_CPLX,
+	LUT_Q_PAR_F0, LUT_Q_PAR_DIR, LUT_Q_PAR_RHO, LUT_Q_PAR_CPLX,
+	LUT_Q_UVA_F0, LUT_Q_UVA_DIR, LUT_Q_UVA_RHO, LUT_Q_UVA_CPLX,
+	LUT_Q_UVB_F0, LUT_Q_UVB_DIR, LUT_Q_UVB_RHO, LUT_Q_UVB_CPLX,
+	LUT_Q_ALB_F0, LUT_Q_ALB_RHO, LUT_Q_ALB_CPLX, LUT_Q_TOA_DW_FLUX,
+	LUT_Q_NUM
+};
+
+// Storage type of the LUT values, see lut_precision of the config file
+enum LutPrecision
+{
+	LUT_FLOAT32 = 0,
+	LUT_FLOAT16,                         // IEEE half
+	LUT_BFLOAT16,                        // upper half of a float32
+	LUT_INT16,                           // value = offset + scale * int16, scale and offset per quantity
+	LUT_PRECISION_NUM
+};
+
+// Placement of the LUT in memory, see lut_huge_pages and lut_numa of the config file
+enum LutHugePages
+{
+	LUT_PAGES_DEFAULT = 0,               // 4K pages of the mapped file
+	LUT_PAGES_TRANSPARENT,               // transparent huge pages
+	LUT_PAGES_EXPLICIT,                  // hugetlbfs pages reserved in vm.nr_hugepages
+	LUT_PAGES_NUM
+};
+
+enum LutNuma
+{
+	LUT_NUMA_DEFAULT = 0,                // first touch
+	LUT_NUMA_INTERLEAVE,                 // pages spread over all the NUMA nodes
+	LUT_NUMA_REPLICATE,                  // one copy per NUMA node
+	LUT_NUMA_NUM
+};
+
+const uint32_t LUT_VERSION = 4;
+const size_t LUT_COL_NAME_LEN = 16;
+const size_t LUT_PAGE_SIZE = 4096;
+// columns of the text LUT
+const size_t LUT_TEXT_COLS = 40;
+const size_t LUT_MAX_CLOUDY_ROWS = 8;
+
+// Binary LUT file (*.swlut):
+//   [LutFileHeader][axis values, float32][quantity names, LUT_COL_NAME_LEN bytes each]
+//   [scale and offset of each quantity, float32][zero padding up to data_offset][data, data_type]
+// The data section is stored block by block, a block being the block_rows rows of one
+// (SZA, VZA, LOS, DEM) node. Inside a block every quantity is a contiguous array of block_rows values:
+//   data[(block * n_cols + quantity) * block_rows + row]
+// A compressed LUT (*.swlutz) holds the same header and metadata followed by one zstd frame
+// per (SZA, VZA) node of the data section, see lut_compression of the config file.
+struct LutFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t n_cols;                     // quantities, LUT_Q_NUM
+	uint64_t n_rows;
+	uint32_t block_rows;                 // rows of one (SZA, VZA, LOS, DEM) node
+	uint32_t axis_len[LUT_AXIS_NUM];
+	uint32_t data_type;                  // LutPrecision
+	uint64_t row_stride[LUT_AXIS_NUM];   // rows between two neighbouring nodes of an axis
+	uint64_t data_offset;
+	uint64_t data_bytes;
+	// rows inside a block used as the clear reference [clear_row_st, clear_row_ed]
+	// and as the cloudy reference, see lut_clear_rows and lut_cloudy_rows of the config file
+	uint32_t clear_row_st;
+	uint32_t clear_row_ed;
+	uint32_t n_cloudy_rows;
+	uint32_t cloudy_rows[LUT_MAX_CLOUDY_ROWS];
+};
+
+class LutStore
+{
+public:
+	LutStore();
+	~LutStore();
+
+	LutStore(const LutStore&) = delete;
+	LutStore& operator=(const LutStore&) = delete;
+
+	// numa_node: node of the copy with lut_numa = replicate, -1 for the node of the calling thread
+	int open(const myConfig& cfg, int numa_node = -1);
+
+	// copy the LUT rows [first_row, first_row + nrows) of all quantities to the rows of dst from dst_row,
+	// column q of dst is quantity q, decoded to float; first_row and nrows are multiples of block_rows,
+	// 1 if a unit of a compressed LUT in the range cannot be read
+	int copy_rows(arma::uword first_row, arma::uword nrows, arma::fmat& dst, arma::uword dst_row) const;
+
+	// ask the kernel to read in the LUT rows [first_row, first_row + nrows) ahead of use,
+	// the pages of the other rows are only read when they are touched; a unit of a compressed LUT
+	// that cannot be read is reported by the copy_rows using it
+	void prefetch(arma::uword first_row, arma::uword nrows) const;
+	// prefetch the LUT rows [row, row + nrows) of every row of first_rows; the units of a compressed LUT
+	// are decompressed in parallel, 1 if one of them cannot be read
+	int prefetch_rows(const arma::uvec& first_rows, arma::uword nrows) const;
+
+	LutPrecision precision() const { return static_cast<LutPrecision>(m_header.data_type); }
+	arma::uword n_rows() const { return m_header.n_rows; }
+	arma::uword n_cols() const { return m_header.n_cols; }
+	arma::uword block_rows() const { return m_header.block_rows; }
+	// bytes of one stored value
+	size_t elem_bytes() const { return m_elem_bytes; }
+	arma::uword axis_len(LutAxis axis) const { return m_header.axis_len[axis]; }
+	arma::uword row_stride(LutAxis axis) const { return m_header.row_stride[axis]; }
+	const arma::fvec& axis_values(LutAxis axis) const { return m_axes[axis]; }
+	const std::string& col_name(arma::uword q) const { return m_col_names[q]; }
+	const std::string& placement() const { return m_placement; }
+	arma::uword clear_row_st() const { return m_header.clear_row_st; }
+	arma::uword clear_row_ed() const { return m_header.clear_row_ed; }
+	arma::uvec cloudy_rows() const;
+
+	void print() const;
+
+	// write the nodes nodes[axis] of every axis and the rows of a block (both ascending) to a new binary LUT
+	// of the same precision, the clear and cloudy reference rows are renumbered
+	int write_subset(const std::vector<arma::uvec>& nodes, const arma::uvec& rows, const std::string& bin_file) const;
+
+private:
+	int map_file(const std::string& bin_file);
+	int attach_shm(const std::string& shm_name, const std::string& bin_file);
+	int publish_shm(int fd, const std::string& shm_name, const std::string& bin_file);
+	void* alloc_resident(size_t nbytes, int numa_node, size_t& map_bytes);
+	int make_resident(int numa_node, const std::string& source);
+	int open_compressed(const std::string& z_file, int numa_node);
+	void load_unit(arma::uword iu) const;
+	int decompress_unit(arma::uword iu) const;
+	// load the units of a compressed LUT of the rows, 1 if one of them cannot be read
+	int ensure_rows(arma::uword first_row, arma::uword nrows) const;
+	int parse_map(const std::string& source);
+	void unmap();
+	void decode_block(arma::uword block, arma::uword q, float* out) const;
+
+	// block_rows encoded values of a quantity in a block
+	const char* quantity_data(arma::uword block, arma::uword q) const
+	{
+		return m_data + ((block * m_header.n_cols + q) * m_header.block_rows) * m_elem_bytes;
+	}
+
+	void* m_map;
+	size_t m_map_bytes;
+	LutHugePages m_huge_pages;
+	LutNuma m_numa;
+	std::string m_placement;
+
+	// compressed LUT (*.swlutz): file offsets of the (SZA, VZA) units, decompressed once on first use
+	int m_lut_fd;
+	std::vector<uint64_t> m_unit_offset;
+	size_t m_unit_bytes;
+	mutable std::unique_ptr<std::once_flag[]> m_unit_once;
+	mutable std::vector<char> m_unit_ok;
+
+	LutFileHeader m_header;
+	const char* m_data;
+	size_t m_elem_bytes;
+	std::vector<arma::fvec> m_axes;
+	std::vector<std::string> m_col_names;
+	std::vector<float> m_scale;
+	std::vector<float> m_offset;
+};
+
+int parse_lut_precision(const std::string& name, LutPrecision& precision);
+const char* lut_precision_name(LutPrecision precision);
+
+// open the LUT of the config file once, it is shared read-only afterwards
+int load_lut_store(const myConfig& cfg, std::shared_ptr<const LutStore>& lut);
+// lut_numa = replicate: one copy of the LUT per NUMA node, luts[node]; otherwise luts holds one shared copy
+int load_lut_replicas(const myConfig& cfg, std::vector<std::shared_ptr<const LutStore>>& luts);
+
+// NUMA node of the calling thread, 0 without NUMA
+int current_numa_node();
+
+int read_text_lut(const std::string& lut_file, arma::uword lut_cols, arma::fmat& lut);
+int write_lut_bin(const arma::fmat& lut, const myConfig& cfg, const std::string& bin_file);
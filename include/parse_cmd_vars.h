@@ -11,6 +11,8 @@ public:
 	std::string m_cfg_file;
 	std::string m_in_path;
 	std::string m_out_path;
+	// max_tile_bytes=N overrides max_tile_bytes of the cfg file; -1 if not given
+	long long m_max_tile_bytes;
 
 private:
 	void print();
@@ -13,6 +13,18 @@ public:
 	void print();
 
 	std::string lut_file;
+	// lut_shm_name		name of the POSIX shared memory segment of the LUT, e.g. /swdr_lut_fy3d;
+	// processes with the same name share one copy of the LUT; default = "" (private mapping)
+	std::string lut_shm_name;
+	// lut_precision		storage of the binary LUT: float32, float16, bfloat16 or int16; default = float32
+	std::string lut_precision;
+	// lut_huge_pages		pages of the LUT: none, transparent or explicit (vm.nr_hugepages); default = none
+	// lut_numa		NUMA placement of the LUT: none, interleave or replicate (one copy per node,
+	// the cell tasks read the copy of the node they run on); default = none
+	std::string lut_huge_pages;
+	std::string lut_numa;
+	// lut_compression		none or zstd (<name>.swlutz, units decompressed on first use); default = none
+	std::string lut_compression;
 	// std::string input_file;
 	// std::string out_file;
 
@@ -27,11 +39,33 @@ public:
 	float f_std;
 	int window;
 	int cpu_core_num;
+	// cell_batch_pixels		retrieval cells with fewer valid pixels are retrieved together, up to this many
+	// pixels per get_SWDR call; default = 0 (one call per cell)
+	int cell_batch_pixels;
+	// strip_rows		rows of an image read, retrieved and written at a time, peak memory follows
+	// the strip size instead of the image size; default = 0 (the whole image at once)
+	int strip_rows;
+	// max_tile_bytes		bytes of the LUT rows x pixels tiles of one get_SWDR call; larger calls are split into
+	// chunks of pixels within it (at least one pixel per chunk); the command line max_tile_bytes=N
+	// overrides it; default = 0 (no limit)
+	arma::uword max_tile_bytes;
+	// run_mode		retrieve, or plan: only bin the scenes and write their cells, LUT rows, tile bytes and
+	// estimated CPU time to <output path>/swdr_plan.json; default = retrieve
+	std::string run_mode;
+	// plan_row_cost_ns		CPU time of get_SWDR per pixel and LUT row in ns, for the plan; calibrate it as
+	// image time * threads / row_pixels of the plan of a retrieved image; default = 2.0
+	float plan_row_cost_ns;
 
 	arma::uvec sza_list;
 	arma::uvec vza_list;
 	arma::fvec dem_list;
 	arma::uvec los_list;
+
+	// lut_clear_rows		first and last row of a LUT block averaged as the clear atmosphere; default = 72, 77 (FY-3D)
+	// lut_cloudy_rows		rows of a LUT block averaged as the cloudy atmosphere; default = 243, 257, 271 (FY-3D)
+	// both are written to the binary LUT when it is generated
+	arma::uvec lut_clear_rows;
+	arma::uvec lut_cloudy_rows;
 private:
 	int parse_list(const std::string& input, arma::uvec& ret) const;
 	int parse_list(const std::string& input, arma::fvec& ret) const;
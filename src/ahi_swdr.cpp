@@ -1,6 +1,7 @@
 //
 #include "file_io.h"
 #include "ahi_swdr.h"
+#include "forward_kernel.h"
 
 #include <boost/algorithm/string.hpp>
 #include "tbb/parallel_for.h"
@@ -9,49 +10,207 @@
 
 #include <fstream>
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
 #include <filesystem>
+#include <limits>
+#include <sstream>
 #include <vector>
 
+namespace
+{
+	// cells k in [st, ed) with edges(k) <= val <= edges(k + 1), ascending, as the inclusive node tests of
+	// the cells: two on an interior node, one elsewhere, none outside the nodes; their number
+	arma::uword find_cells(float val, const arma::fvec& edges, arma::uword st, arma::uword ed, arma::uword cells[2])
+	{
+		const arma::uword num = edges.n_elem;
+		if (num < 2 || !(val >= edges(0) && val <= edges(num - 1))) return 0;
+
+		const arma::uword up = std::upper_bound(edges.begin(), edges.end(), val) - edges.begin();
+		const arma::uword k = std::min(up - 1, num - 2);
+		arma::uword n = 0;
+		if (k > 0 && val == edges(k) && k - 1 >= st && k - 1 < ed) cells[n++] = k - 1;
+		if (k >= st && k < ed) cells[n++] = k;
+		return n;
+	}
+
+	// snow NDSI windows [0.1 + 0.01 i, 0.11 + 0.01 i) of the retrieval, i < SNOW_NDSI_BINS
+	const arma::uword SNOW_NDSI_BINS = 90;
+
+	// window of a snow pixel, the last one holding ndsi as with a loop over the windows;
+	// SNOW_NDSI_BINS for none
+	arma::uword snow_ndsi_bin(float ndsi)
+	{
+		if (!std::isfinite(ndsi)) return SNOW_NDSI_BINS;
+
+		const long guess = static_cast<long>(std::floor((ndsi - 0.1) / 0.01));
+		for (long i = guess + 1; i >= guess - 1; i--)
+		{
+			if (i < 0 || i >= static_cast<long>(SNOW_NDSI_BINS)) continue;
+			if (ndsi >= static_cast<float>(i * 0.01 + 0.1) && ndsi < static_cast<float>(i * 0.01 + 0.11)) return i;
+		}
+		return SNOW_NDSI_BINS;
+	}
+
+	// slice is of the input image at the valid pixels
+	arma::fvec valid_pixels(const arma::fcube& data, arma::uword is, const arma::uvec& valid)
+	{
+		return data.slice(is).elem(valid);
+	}
+
+	// bands of the input image up to the band 7 radiance: flag, geometry, DEM and radiances
+	const arma::uword GEOMETRY_BANDS = 12;
+
+	// LUT rows x pixels float tiles alive at once in a get_SWDR call (the radiances, clear/cloudy
+	// references and NDSI, and the DEM rows taken in interp_dem), for the plan
+	const arma::uword GET_SWDR_TILES = 15;
+
+	// str as a JSON string
+	std::string json_string(const std::string& str)
+	{
+		std::string out = "\"";
+		for (const char c : str)
+		{
+			if (c == '"' || c == '\\') out += '\\';
+			out += c;
+		}
+		return out + "\"";
+	}
+
+	// SZA, VZA at the top of the atmosphere, LOS (in degree) and DEM (in km) at the valid pixels
+	void pixel_geometry(const arma::fcube& data, const arma::uvec& valid,
+		arma::fvec& sza, arma::fvec& vza, arma::fvec& los, arma::fvec& dem)
+	{
+		sza = valid_pixels(data, 1, valid) / 100.0;
+		vza = valid_pixels(data, 2, valid) / 100.0;
+		//view zenith angle at the top of the atmosphere
+		vza = arma::sin(arma::datum::pi * vza / 180.0);
+		vza = vza * 6371.0 / 6471.0;
+		vza = 180.0 * arma::asin(vza) / arma::datum::pi;
+
+		los = valid_pixels(data, 3, valid) / 100.0;
+		dem = valid_pixels(data, 4, valid) / 1000.0;
+	}
+
+	// TOA albedo i0 + cplx / (1 / x - rho) times the quantity q_scale at the LUT rows rows of the cell,
+	// x the albedo of the pixel
+	arma::fvec toa_rows(const PreparedCellLut& lut, arma::uword q_i0, arma::uword q_rho, arma::uword q_cplx,
+		arma::uword q_scale, arma::uword cell, float x, const arma::uvec& rows)
+	{
+		const float* i0 = lut.quantities.slice_colptr(cell, q_i0);
+		const float* rho = lut.quantities.slice_colptr(cell, q_rho);
+		const float* cplx = lut.quantities.slice_colptr(cell, q_cplx);
+		const float* scale = lut.quantities.slice_colptr(cell, q_scale);
+		const float inv_x = 1 / x;
+		arma::fvec out(rows.n_elem);
+		for (arma::uword k = 0; k < rows.n_elem; k++)
+		{
+			const arma::uword r = rows(k);
+			out(k) = i0[r] + (1 / (inv_x - rho[r])) * cplx[r];
+			out(k) *= scale[r];
+		}
+		return out;
+	}
+
+	// LUT quantities i0, rho and cplx of the bands of forward_bands
+	const arma::uword FORWARD_LUT_Q[FWD_BAND_NUM][3] = {
+		{ LUT_Q_I0_B1, LUT_Q_RHO_B1, LUT_Q_CPLX_B1 },
+		{ LUT_Q_I0_B3, LUT_Q_RHO_B3, LUT_Q_CPLX_B3 },
+		{ LUT_Q_I0_B4, LUT_Q_RHO_B4, LUT_Q_CPLX_B4 },
+		{ LUT_Q_I0_B6, LUT_Q_RHO_B6, LUT_Q_CPLX_B6 },
+		{ LUT_Q_I0_B7, LUT_Q_RHO_B7, LUT_Q_CPLX_B7 } };
+
+	// tiles (LUT rows x pixels, allocated) of the TOA radiances of bands 1, 3, 6 and 7 and of the NDSI
+	// of the cell of every pixel, from the surface reflectances of the pixels
+	void forward_tiles(const PreparedCellLut& lut, const arma::uvec& pixel_cell,
+		const arma::fvec& ref_b1, const arma::fvec& ref_b3, const arma::fvec& ref_b4, const arma::fvec& ref_b6, const arma::fvec& ref_b7,
+		arma::fmat& rad_b1, arma::fmat& rad_b3, arma::fmat& rad_b6, arma::fmat& rad_b7, arma::fmat& ndsi)
+	{
+		for (arma::uword j = 0; j < pixel_cell.n_elem; j++)
+		{
+			ForwardColumns cols;
+			for (int b = 0; b < FWD_BAND_NUM; b++)
+			{
+				cols.i0[b] = lut.quantities.slice_colptr(pixel_cell(j), FORWARD_LUT_Q[b][0]);
+				cols.rho[b] = lut.quantities.slice_colptr(pixel_cell(j), FORWARD_LUT_Q[b][1]);
+				cols.cplx[b] = lut.quantities.slice_colptr(pixel_cell(j), FORWARD_LUT_Q[b][2]);
+			}
+			const float inv_ref[FWD_BAND_NUM] = { 1 / ref_b1(j), 1 / ref_b3(j), 1 / ref_b4(j), 1 / ref_b6(j), 1 / ref_b7(j) };
+			float* const out[FWD_OUT_NUM] = { rad_b1.colptr(j), rad_b3.colptr(j), rad_b6.colptr(j), rad_b7.colptr(j), ndsi.colptr(j) };
+			forward_bands(cols, inv_ref, lut.quantities.n_rows, out);
+		}
+	}
 
+	// quantity q of the cell at the LUT rows rows
+	arma::fvec quantity_rows(const PreparedCellLut& lut, arma::uword q, arma::uword cell, const arma::uvec& rows)
+	{
+		const float* val = lut.quantities.slice_colptr(cell, q);
+		arma::fvec out(rows.n_elem);
+		for (arma::uword k = 0; k < rows.n_elem; k++)
+			out(k) = val[rows(k)];
+		return out;
+	}
 
-ahi_swdr::ahi_swdr(const myConfig& cfg) :
-	m_lut_file(cfg.lut_file), m_toa_avg_num(cfg.toa_avg_num),
+	// flux f0 + f0x / (1 - f0x) * cplx, f0x = x * rho, at the LUT rows rows of the cell, x the albedo of the pixel
+	arma::fvec flux_rows(const PreparedCellLut& lut, arma::uword q_f0, arma::uword q_rho, arma::uword q_cplx,
+		arma::uword cell, float x, const arma::uvec& rows)
+	{
+		const float* f0 = lut.quantities.slice_colptr(cell, q_f0);
+		const float* rho = lut.quantities.slice_colptr(cell, q_rho);
+		const float* cplx = lut.quantities.slice_colptr(cell, q_cplx);
+		arma::fvec out(rows.n_elem);
+		for (arma::uword k = 0; k < rows.n_elem; k++)
+		{
+			const arma::uword r = rows(k);
+			const float f0x = x * rho[r];
+			out(k) = f0[r] + f0x / (1 - f0x) * cplx[r];
+		}
+		return out;
+	}
+}
+
+
+ahi_swdr::ahi_swdr(const myConfig& cfg, std::shared_ptr<const LutStore> lut) :
+	m_lut_file(cfg.lut_file), m_lut(std::move(lut)), m_toa_avg_num(cfg.toa_avg_num),
 	m_ref_range(cfg.ref_range), m_ref_bin_num(cfg.ref_bin_num),
-	m_f_std(cfg.f_std), m_window(cfg.window),
-	m_sza_list(cfg.sza_list), m_vza_list(cfg.vza_list),
-	m_dem_list(cfg.dem_list), m_los_list(cfg.los_list),
-	m_sza_list_ft(arma::conv_to<arma::fvec>::from(m_sza_list)),
-	m_vza_list_ft(arma::conv_to<arma::fvec>::from(m_vza_list)),
-	m_los_list_ft(arma::conv_to<arma::fvec>::from(m_los_list))
+	m_f_std(cfg.f_std), m_window(cfg.window), m_cell_batch_pixels(cfg.cell_batch_pixels),
+	m_strip_rows(cfg.strip_rows), m_max_tile_bytes(cfg.max_tile_bytes)
 {
-	m_up_sza = 0;
-	m_dw_sza = 0;
-	m_up_vza = 0;
-	m_dw_vza = 0;
-	m_up_dem = 0;
-	m_dw_dem = 0;
-	m_up_dem10 = 0;
-	m_dw_dem10 = 0;
-	m_min_los = 0;
-
 	//���˲��ұ��Ĳ���
 	//idx_filter_sza = 87480;
 	//idx_filter_vza = 9720;
 	//idx_filter_los = 1944;
 	//idx_filter_dem = 324;
 
-	idx_filter_sza = 86400;
-	idx_filter_vza = 10800;
-	idx_filter_los = 2160;
-	idx_filter_dem = 360;
+	//the LUT is read only once and shared by all the retrievers of a batch
+	if (m_lut == nullptr)
+	{
+		if (load_lut_replicas(cfg, m_lut_nodes) != 0) exit(EXIT_FAILURE);
+		m_lut = m_lut_nodes[std::min<size_t>(current_numa_node(), m_lut_nodes.size() - 1)];
+	}
 
-	//���ұ�����
-	lut_cols = 40; 
+	//axis lists of the LUT, the same as the config file unless the LUT is a subset (swdr_lut_subset)
+	m_sza_list_ft = m_lut->axis_values(LUT_AXIS_SZA);
+	m_vza_list_ft = m_lut->axis_values(LUT_AXIS_VZA);
+	m_los_list_ft = m_lut->axis_values(LUT_AXIS_LOS);
+	m_dem_list = m_lut->axis_values(LUT_AXIS_DEM);
+	m_sza_list = arma::conv_to<arma::uvec>::from(arma::round(m_sza_list_ft));
+	m_vza_list = arma::conv_to<arma::uvec>::from(arma::round(m_vza_list_ft));
+	m_los_list = arma::conv_to<arma::uvec>::from(arma::round(m_los_list_ft));
 
+	//strides and reference rows of the LUT, from its header
+	idx_filter_sza = m_lut->row_stride(LUT_AXIS_SZA);
+	idx_filter_vza = m_lut->row_stride(LUT_AXIS_VZA);
+	idx_filter_los = m_lut->row_stride(LUT_AXIS_LOS);
+	idx_filter_dem = m_lut->row_stride(LUT_AXIS_DEM);
 
-	std::cout << "Begin to read LUT file: " << m_lut_file << std::endl;
-	if (read_lut(m_lut_file, lut_cols) != 0) exit(EXIT_FAILURE);
-	std::cout << "LUT file have been read.\n";
+	idx_clear_st = m_lut->clear_row_st();
+	idx_clear_ed = m_lut->clear_row_ed();
+	idx_cloudy = m_lut->cloudy_rows();
+
+	if (check_lut() != 0) exit(EXIT_FAILURE);
 
 	m_sza_min = m_sza_list(0);
 	m_sza_max = m_sza_list(m_sza_list.n_elem - 1);
@@ -64,8 +223,20 @@ ahi_swdr::ahi_swdr(const myConfig& cfg) :
 
 }
 
+ahi_swdr::ahi_swdr(const myConfig& cfg, const std::vector<std::shared_ptr<const LutStore>>& lut_nodes) :
+	ahi_swdr(cfg, lut_nodes.front())
+{
+	if (lut_nodes.size() > 1) m_lut_nodes = lut_nodes;
+}
+
 ahi_swdr::~ahi_swdr() = default;
 
+const LutStore& ahi_swdr::local_lut() const
+{
+	if (m_lut_nodes.size() < 2) return *m_lut;
+	return *m_lut_nodes[std::min<size_t>(current_numa_node(), m_lut_nodes.size() - 1)];
+}
+
 int ahi_swdr::sequential_run(const std::string& input_path, const std::string& output_path)
 {
 	using namespace std;
@@ -143,7 +314,9 @@ int ahi_swdr::batch_run_tbb(const myConfig& cfg,
 			}
 
 			string out_file = mypath.u8string();
-			ahi_swdr ahisdr(cfg);
+
+			//one LUT copy per NUMA node: each cell task reads the copy of the node it runs on
+			ahi_swdr ahisdr(cfg, m_lut_nodes.size() > 1 ? m_lut_nodes : vector<shared_ptr<const LutStore>>{ m_lut });
 			if (ahisdr.retrieve_image(in_file, out_file) != 0)
 			//if (retrieve_image(in_file, out_file) != 0)
 			{
@@ -160,6 +333,53 @@ int ahi_swdr::batch_run_tbb(const myConfig& cfg,
 	return 0;
 }
 
+int ahi_swdr::plan_run(const myConfig& cfg, const std::string& input_path, const std::string& plan_file)
+{
+	using namespace std;
+
+	vector<string> filelist;
+	int ok = glob_filelist(input_path, ".tif", filelist);
+	if (ok != 0) return 1;
+
+	//concurrent get_SWDR calls of a scene: the TBB threads of the retrieval
+	const arma::uword threads = (cfg.cpu_core_num > 0) ? cfg.cpu_core_num : tbb::task_scheduler_init::default_num_threads();
+
+	ofstream json{ plan_file };
+	if (!json.is_open())
+	{
+		cout << "[Error] cannot open plan file: " << plan_file << endl;
+		return 1;
+	}
+
+	json << "{\n";
+	json << "  \"threads\": " << threads << ",\n";
+	json << "  \"row_cost_ns\": " << cfg.plan_row_cost_ns << ",\n";
+	json << "  \"max_tile_bytes\": " << m_max_tile_bytes << ",\n";
+	json << "  \"scenes\": [";
+	size_t nscenes = 0;
+	for (auto& in_file : filelist)
+	{
+		cout << "-> " << in_file << endl;
+
+		ostringstream scene;
+		if (plan_image(in_file, threads, cfg.plan_row_cost_ns, scene) != 0)
+		{
+			cerr << "cannot plan file: " << in_file << endl;
+			continue;
+		}
+		json << (nscenes++ == 0 ? "\n" : ",\n") << scene.str();
+	}
+	json << "\n  ]\n}\n";
+	json.close();
+
+	cout << endl;
+	cout << "--------------------------------------------------\n";
+	cout << "The plan of " << nscenes << " scenes has been written to: " << plan_file << endl;
+	cout << "--------------------------------------------------\n";
+
+	return 0;
+}
+
 
 int ahi_swdr::retrieve_image(const std::string& input_file, const std::string& out_file)
 {
@@ -167,586 +387,690 @@ int ahi_swdr::retrieve_image(const std::string& input_file, const std::string& o
 	using namespace arma;
 	namespace fs = std::filesystem;
 
-	fcube data;
-	int ok = read_3d_geotif(input_file, data);
+	imageStripReader reader;
+	int ok = reader.open(input_file);
 	if (ok != 0) return 1;
+
+	const uword nrows = reader.n_rows();
+	const uword ncols = reader.n_cols();
+	//strip_rows = 0: the whole image as one strip, read once with all its bands
+	const uword strip_rows = (m_strip_rows == 0 || m_strip_rows > nrows) ? nrows : m_strip_rows;
+	const uword nstrips = (strip_rows == 0) ? 0 : (nrows + strip_rows - 1) / strip_rows;
+
+	//(1) valid pixels of the cells over the whole image, strip by strip from the geometry bands
+	fcube data;
+	ImageCells cells;
+	for (uword is = 0; is < nstrips; is++)
+	{
+		const uword row_st = is * strip_rows;
+		ok = reader.read_rows(row_st, std::min(strip_rows, nrows - row_st), nstrips == 1 ? 0 : GEOMETRY_BANDS, data);
+		if (ok != 0) return 1;
+		count_cells(data, cells);
+	}
 	cout << input_file << " have been read.\n";
+	cout << "-> valid pixels: " << cells.nvalid << " of " << nrows * ncols << endl;
 
+	ok = locate_cells(cells);
+	if (ok != 0) return 1;
 
-	//hdf
-	const fmat flag_mat = data.slice(0);
-	const fmat sza_mat = data.slice(1) / 100.0; // in degree
-	const fmat vza_mat = data.slice(2) / 100.0; // in degree
-	const fmat los_mat = data.slice(3) / 100.0; // in degree
-	const fmat dem_mat = data.slice(4) / 1000.0; // in km
-
-	//const fmat toa_rad_mat_b1 = data.slice(5) / 10.0;
-	//const fmat toa_rad_mat_b2 = data.slice(6) / 10.0;
-	//const fmat toa_rad_mat_b3 = data.slice(7) / 10.0; //toa_rad_mat
-	//const fmat toa_rad_mat_b4 = data.slice(8) / 10.0;
-	const fmat toa_rad_mat_b1 = data.slice(7) / 10.0;
-	const fmat toa_rad_mat_b2 = data.slice(8) / 10.0;
-	const fmat toa_rad_mat_b3 = data.slice(5) / 10.0; //toa_rad_mat
-	const fmat toa_rad_mat_b4 = data.slice(6) / 10.0;
-	const fmat toa_rad_mat_b5 = data.slice(9) / 100.0;
-	const fmat toa_rad_mat_b6 = data.slice(10) / 100.0;
-	const fmat toa_rad_mat_b7 = data.slice(11) / 500.0;
-
-	const fmat band1_ref_mat = data.slice(12) / 1000.0;
-	const fmat band2_ref_mat = data.slice(13) / 1000.0;
-	const fmat band3_ref_mat = data.slice(14) / 1000.0; //blue_ref_mat
-	const fmat band4_ref_mat = data.slice(15) / 1000.0;
-	const fmat band5_ref_mat = data.slice(16) / 1000.0;
-	const fmat band6_ref_mat = data.slice(17) / 1000.0;
-	const fmat band7_ref_mat = data.slice(18) / 1000.0;
+	//read in only the SZA/VZA nodes of the image, in every NUMA copy the cell tasks may read;
+	//the nodes of a compressed LUT are decompressed here in parallel
+	const uvec node_st = node_rows(cells);
+	for (const auto& lut : m_lut_nodes.size() > 1 ? m_lut_nodes : vector<shared_ptr<const LutStore>>{ m_lut })
+	{
+		if (lut->prefetch_rows(node_st, idx_filter_vza) != 0) return 1;
+	}
 
-	const fmat sw_alb_mat = data.slice(19) / 1000.0;
-	const fmat vis_alb_mat = data.slice(20) / 1000.0; //
-	
-	const uword nrows = flag_mat.n_rows;
-	const uword ncols = flag_mat.n_cols;
+	//---------------------------------------------------------
 
-	// -1 for invalid data
-	fmat swdr_mat = zeros<fmat>(nrows, ncols) - 1.0;
-	fmat sw_dir_mat = zeros<fmat>(nrows, ncols) - 1.0;
-	fmat par_mat = zeros<fmat>(nrows, ncols) - 1.0;
-	fmat pardir_mat = zeros<fmat>(nrows, ncols) - 1.0;
-	fmat uva_mat = zeros<fmat>(nrows, ncols) - 1.0;
-	fmat uvb_mat = zeros<fmat>(nrows, ncols) - 1.0;
-	fmat toa_up_flux_mat = zeros<fmat>(nrows, ncols) - 1.0;
-	fmat rho_mat = zeros<fmat>(nrows, ncols) - 1.0;
+	cout << "Begin to retrieve SWDR from MODIS data...\n";
+	wall_clock timer;
+	timer.tic();
 
-	//�������,�ȶ�άתһά//��һάת��ά
-	fvec sza_mat_v = sza_mat.as_col();
-	fvec myvza_mat_v = vza_mat.as_col();
-	//��vec����һ�����������У��
-	myvza_mat_v = arma::sin(arma::datum::pi * myvza_mat_v / 180.0);
-	myvza_mat_v = myvza_mat_v * 6371.0 / 6471.0;
-	fvec vza_mat_v = 180.0 * arma::asin(myvza_mat_v) / arma::datum::pi;
-
-	fvec los_mat_v = los_mat.as_col();
-	fvec dem_mat_v = dem_mat.as_col();
-	fvec flag_mat_v = flag_mat.as_col();
-
-	fvec toa_rad_mat_b1_v = toa_rad_mat_b1.as_col();
-	fvec toa_rad_mat_b2_v = toa_rad_mat_b2.as_col();
-	fvec toa_rad_mat_b3_v = toa_rad_mat_b3.as_col();
-	fvec toa_rad_mat_b4_v = toa_rad_mat_b4.as_col();
-	fvec toa_rad_mat_b5_v = toa_rad_mat_b5.as_col();
-	fvec toa_rad_mat_b6_v = toa_rad_mat_b6.as_col();
-	fvec toa_rad_mat_b7_v = toa_rad_mat_b7.as_col();
-
-	fvec band1_ref_mat_v = band1_ref_mat.as_col();
-	fvec band2_ref_mat_v = band2_ref_mat.as_col();
-	fvec band3_ref_mat_v = band3_ref_mat.as_col();
-	fvec band4_ref_mat_v = band4_ref_mat.as_col();
-	fvec band5_ref_mat_v = band5_ref_mat.as_col();
-	fvec band6_ref_mat_v = band6_ref_mat.as_col();
-	fvec band7_ref_mat_v = band7_ref_mat.as_col();
-	fvec sw_alb_mat_v = sw_alb_mat.as_col();
-	fvec vis_alb_mat_v = vis_alb_mat.as_col();
-
-	fvec swdr_v = swdr_mat.as_col();
-	fvec sw_dir_v = sw_dir_mat.as_col();
-	fvec par_v = par_mat.as_col();
-	fvec pardir_v = pardir_mat.as_col();
-	fvec uva_v = uva_mat.as_col();
-	fvec uvb_v = uvb_mat.as_col();
-	fvec toa_up_flux_v = toa_up_flux_mat.as_col();
-	fvec rho_v = rho_mat.as_col();
-
-	//�ҵ�Ӱ���Ӧ��sza���ֵ��Сֵ
-	float sza_min_image = sza_mat_v.min();
-	float sza_max_image = sza_mat_v.max();
-
-	uword up_sza_idx_image;
-	uword dw_sza_idx_image;
-	int flag = filter_sza(sza_min_image, sza_max_image, up_sza_idx_image, dw_sza_idx_image, m_sza_list_ft, m_sza_min, m_sza_max);
-	if (flag != 0) return 1;
+	//(2) retrieval strip by strip, each strip written to its rows of a temporary file
+	//renamed to out_file only once complete, so a failed scene leaves no partial output
+	const string part_file = out_file + ".part";
+	imageGeoInfo geoinfo{ input_file };
+	imageStripWriter writer;
+	auto discard = [&]()
+	{
+		writer.close();
+		std::error_code ec;
+		fs::remove(part_file, ec);
+		return 1;
+	};
+	ok = writer.open(part_file, nrows, ncols, 10, geoinfo);
+	if (ok != 0) return discard();
 
-	//�ҵ�Ӱ���Ӧ��vza���ֵ��Сֵ
-	float vza_min_image = vza_mat_v.min();
-	float vza_max_image = vza_mat_v.max();
+	for (uword is = 0; is < nstrips; is++)
+	{
+		const uword row_st = is * strip_rows;
+		if (nstrips > 1)
+		{
+			ok = reader.read_rows(row_st, std::min(strip_rows, nrows - row_st), 0, data);
+			if (ok != 0) return discard();
+		}
 
-	uword up_vza_idx_image;
-	uword dw_vza_idx_image;
-	flag = filter_sza(vza_min_image, vza_max_image, up_vza_idx_image, dw_vza_idx_image, m_vza_list_ft, m_vza_min, m_vza_max);
-	if (flag != 0) return 1;
+		Cube<short> fluxes;
+		ok = retrieve_strip(data, cells, fluxes);
+		if (ok != 0) return discard();
 
-	//---------------------------------------------------------
+		ok = writer.write_rows(row_st, fluxes);
+		if (ok != 0) return discard();
+	}
+	ok = writer.close();
+	if (ok != 0) return discard();
 
-	cout << "Begin to retrieve SWDR from MODIS data...\n";
-	wall_clock timer;
+	std::error_code ec;
+	fs::rename(part_file, out_file, ec);
+	if (ec)
+	{
+		cout << "[Error] cannot rename " << part_file << " to " << out_file << ": " << ec.message() << endl;
+		return discard();
+	}
 
-	//==�������===========
-	timer.tic();
-	//----------------------------------------
-	for (uword i = dw_sza_idx_image; i < up_sza_idx_image; i++) //10��,���ֵ��85
+	cout << "-> " << " image time: " << timer.toc() << " seconds." << endl;
+
+	cout << "To estimate SWDR has been finished.\n";
+
+	cout << "Save SWDR MODIS to file: " << out_file << endl;
+	return 0;
+}
+
+
+int ahi_swdr::plan_image(const std::string& input_file, arma::uword threads, double row_cost_ns, std::ostream& json) const
+{
+	using namespace std;
+	using namespace arma;
+
+	imageStripReader reader;
+	int ok = reader.open(input_file);
+	if (ok != 0) return 1;
+
+	const uword nrows = reader.n_rows();
+	const uword ncols = reader.n_cols();
+	const uword strip_rows = (m_strip_rows == 0 || m_strip_rows > nrows) ? nrows : m_strip_rows;
+	const uword nstrips = (strip_rows == 0) ? 0 : (nrows + strip_rows - 1) / strip_rows;
+
+	//the cells as retrieve_image counts them, from the geometry bands only
+	fcube data;
+	ImageCells cells;
+	for (uword is = 0; is < nstrips; is++)
 	{
-		uword up_sza_idx;
-		uword dw_sza_idx;
-		uword up_vza_idx;
-		uword dw_vza_idx;
-		uword up_dem_idx;
-		uword dw_dem_idx;
-		uword los_idx;
-
-		//------------------------------------------------
-		dw_sza_idx = i;
-		up_sza_idx = i + 1;
-		m_dw_sza = m_sza_list(i);
-		m_up_sza = m_sza_list(i+1);
-
-		//dw_SZA_indx
-		uword st = dw_sza_idx * idx_filter_sza;
-		uword ed = st + idx_filter_sza - 1;
-		fmat lut_ds = m_lut.rows(span(st, ed)); //lut1
-		//up_SZA_indx
-		st = up_sza_idx * idx_filter_sza;
-		ed = st + idx_filter_sza - 1;
-		fmat lut_us = m_lut.rows(span(st, ed)); //lut3
-
-		//==================================================
-		//VZA
-		for (uword j = dw_vza_idx_image; j < up_vza_idx_image; j++)
+		const uword row_st = is * strip_rows;
+		ok = reader.read_rows(row_st, std::min(strip_rows, nrows - row_st), GEOMETRY_BANDS, data);
+		if (ok != 0) return 1;
+		count_cells(data, cells);
+	}
+
+	ok = locate_cells(cells);
+	if (ok != 0) return 1;
+
+	//pixels of each cell as retrieve_strip bins them: cell_count counts a pixel on a node in the
+	//cells on both sides, the retrieval puts it in one retrieved cell only
+	uvec binned;
+	if (cells.nvalid > 0)
+	{
+		binned.zeros(cells.cell_count.n_elem);
+		for (uword is = 0; is < nstrips; is++)
 		{
-			dw_vza_idx = j;
-			up_vza_idx = j + 1;
-			m_dw_vza = m_vza_list(j);
-			m_up_vza = m_vza_list(j + 1);
-
-			//-----------------------------
-			uvec idx_tile = find(sza_mat_v <= m_up_sza && sza_mat_v >= m_dw_sza && vza_mat_v <= m_up_vza && vza_mat_v >= m_dw_vza && flag_mat_v == 1);
-			if (idx_tile.n_elem < 5) continue;
-			//-----------------------------
-			//
-			//(1)dw_SZA_dw_VZA_indx
-			st = dw_vza_idx * idx_filter_vza;
-			ed = st + idx_filter_vza - 1;
-			fmat lut_ds_dv = lut_ds.rows(span(st, ed));
-			//(2)dw_SZA_up_VZA_indx
-			st = up_vza_idx * idx_filter_vza;
-			ed = st + idx_filter_vza - 1;
-			fmat lut_ds_uv = lut_ds.rows(span(st, ed));
-			//(3)up_SZA_dw_VZA_indx
-			st = dw_vza_idx * idx_filter_vza;
-			ed = st + idx_filter_vza - 1;
-			fmat lut_us_dv = lut_us.rows(span(st, ed));
-			//(4)up_SZA_up_vza_idx
-			st = up_vza_idx * idx_filter_vza;
-			ed = st + idx_filter_vza - 1;
-			fmat lut_us_uv = lut_us.rows(span(st, ed));
-
-			//==================================================
-			//LOS
-			for (uword m = 0; m < 5; m++)
+			const uword row_st = is * strip_rows;
+			if (nstrips > 1)
 			{
-				float m_dw_los = 45 * m - 22.5;
-				float m_up_los = 45 * m + 22.5;
-				if (m_dw_los < 0) // vza < min
-				{
-					m_dw_los = 0;
-				}
-				if (m_up_los > 180) // vza > max
-				{
-					m_up_los = 180;
-				}
-				m_min_los = m_los_list_ft(m);
-				//-----------------------------
-				//=========los idx===============
-				uvec idx = find(m_los_list_ft == m_min_los);
-				if (idx.n_elem == 0)
-				{
-					std::cout << "[Error] cannot find the min_los: " << m_min_los << endl;
-					return 1;
-				}
-				los_idx = idx(0);
-
-				//-----------------------------
-				idx_tile = find(sza_mat_v <= m_up_sza && sza_mat_v >= m_dw_sza && vza_mat_v <= m_up_vza
-					&& vza_mat_v >= m_dw_vza && los_mat_v <= m_up_los && los_mat_v >= m_dw_los && flag_mat_v == 1);
-				if (idx_tile.n_elem < 5) continue;
-				//-----------------------------
-
-				//LOS_indx
-				st = los_idx * idx_filter_los;
-				ed = st + idx_filter_los - 1;
-				//(1)dw_SZA_dw_VZA_LOS_indx
-				fmat lut_ds_dv_l = lut_ds_dv.rows(span(st, ed));
-				//(2)dw_SZA_up_VZA_LOS_indx
-				fmat lut_ds_uv_l = lut_ds_uv.rows(span(st, ed));
-				//(3)up_SZA_dw_VZA_LOS_indx
-				fmat lut_us_dv_l = lut_us_dv.rows(span(st, ed));
-				//(4)up_SZA_up_VZA_LOS_indx
-				fmat lut_us_uv_l = lut_us_uv.rows(span(st, ed));
-
-				//==================================================
-				for (uword n = 0; n < 5; n++)
-				{
-					m_dw_dem = 1 * n;
-					m_up_dem = 1 * (n + 1);
-					if (n == 4) // dem > max
-					{
-						m_up_dem = 5.9;
-					}
-					//-------------------------
-					//==========find up_dem and dw_dem idx===============
-					idx = find(m_dem_list == m_up_dem);
-					if (idx.n_elem == 0)
-					{
-						std::cout << "[Error] cannot find the up_dem: " << m_up_dem << endl;
-						return 1;
-					}
-					up_dem_idx = idx(0);
+				ok = reader.read_rows(row_st, std::min(strip_rows, nrows - row_st), GEOMETRY_BANDS, data);
+				if (ok != 0) return 1;
+			}
 
-					idx = find(m_dem_list == m_dw_dem);
-					if (idx.n_elem == 0)
-					{
-						std::cout << "[Error] cannot find the dw_dem: " << m_dw_dem << endl;
-						return 1;
-					}
-					dw_dem_idx = idx(0);
-
-					//-----------------------------
-					//�ж����ڼ���Ŀ�
-					idx_tile = find(sza_mat_v >= m_dw_sza && sza_mat_v <= m_up_sza && vza_mat_v >= m_dw_vza 
-						&& vza_mat_v <= m_up_vza && los_mat_v >= m_dw_los && los_mat_v <= m_up_los
-						&& dem_mat_v <= m_up_dem && dem_mat_v >= m_dw_dem && flag_mat_v == 1 && toa_rad_mat_b6_v > 0 && toa_rad_mat_b7_v > 0);
-					//if (idx_tile.n_elem == 0) continue;
-					if (idx_tile.n_elem < 5) continue; //�ĳ�С��5��������2������
-
-					//-----------------------------
-					//
-					st = dw_dem_idx * idx_filter_dem;
-					ed = st + idx_filter_dem * (up_dem_idx - dw_dem_idx + 1) - 1;
-
-					//(1)dw_SZA_dw_VZA_LOS_dem_indx
-					fmat lut_ds_dv_ld = lut_ds_dv_l.rows(span(st, ed));
-					//(2)dw_SZA_up_VZA_LOS_dem_indx
-					fmat lut_ds_uv_ld = lut_ds_uv_l.rows(span(st, ed));
-					//(3)up_SZA_dw_VZA_LOS_dem_indx
-					fmat lut_us_dv_ld = lut_us_dv_l.rows(span(st, ed));
-					//(4)up_SZA_up_VZA_LOS_dem_indx
-					fmat lut_us_uv_ld = lut_us_uv_l.rows(span(st, ed));
-
-					//�ϲ���
-					fmat lut = lut_ds_dv_ld;
-					lut.insert_rows(lut.n_rows, lut_ds_uv_ld);
-					lut.insert_rows(lut.n_rows, lut_us_dv_ld);
-					lut.insert_rows(lut.n_rows, lut_us_uv_ld);
-
-					////�Բ��ұ����зֿ�
-					//=============��һ�ηֿ�==================================================================
-					//��Ӱ����зֿ�
-					fvec dem_sub_v = dem_mat_v(idx_tile);
-					fvec sza_sub_v = sza_mat_v(idx_tile);
-					fvec vza_sub_v = vza_mat_v(idx_tile);
-
-					fvec toa_rad_b1_sub_v = toa_rad_mat_b1_v(idx_tile);
-					fvec toa_rad_b2_sub_v = toa_rad_mat_b2_v(idx_tile);
-				    fvec toa_rad_b3_sub_v = toa_rad_mat_b3_v(idx_tile);
-					fvec toa_rad_b4_sub_v = toa_rad_mat_b4_v(idx_tile);
-					fvec toa_rad_b5_sub_v = toa_rad_mat_b5_v(idx_tile);
-					fvec toa_rad_b6_sub_v = toa_rad_mat_b6_v(idx_tile);
-					fvec toa_rad_b7_sub_v = toa_rad_mat_b7_v(idx_tile);
-
-					fvec toa_rad_ndsi_sub_v = (toa_rad_b4_sub_v / 593.84 - toa_rad_b6_sub_v / 76.53) / (toa_rad_b4_sub_v / 593.84 + toa_rad_b6_sub_v / 76.53);
-
-					fvec band1_ref_sub_v = band1_ref_mat_v(idx_tile);
-					fvec band2_ref_sub_v = band2_ref_mat_v(idx_tile);
-					fvec band3_ref_sub_v = band3_ref_mat_v(idx_tile);
-					fvec band4_ref_sub_v = band4_ref_mat_v(idx_tile);
-					fvec band5_ref_sub_v = band5_ref_mat_v(idx_tile);
-					fvec band6_ref_sub_v = band6_ref_mat_v(idx_tile);
-					fvec band7_ref_sub_v = band7_ref_mat_v(idx_tile);
-					fvec sw_alb_sub_v = sw_alb_mat_v(idx_tile);
-					fvec vis_alb_sub_v = vis_alb_mat_v(idx_tile);
-
-					uword nelem_tiles = toa_rad_b3_sub_v.n_elem;
-
-					fvec swdr_sub_v = zeros<fvec>(nelem_tiles) - 1.0;
-					fvec sw_dir_sub_v = zeros<fvec>(nelem_tiles) - 1.0;
-					fvec par_sub_v = zeros<fvec>(nelem_tiles) - 1.0;
-					fvec pardir_sub_v = zeros<fvec>(nelem_tiles) - 1.0;
-					fvec uva_sub_v = zeros<fvec>(nelem_tiles) - 1.0;
-					fvec uvb_sub_v = zeros<fvec>(nelem_tiles) - 1.0;
-					fvec toa_up_flux_sub_v = zeros<fvec>(nelem_tiles) - 1.0;
-					fvec rho_sub_v = zeros<fvec>(nelem_tiles) - 1.0;
-
-					////================================================================================================================
-					
-					//���ݻ�ѩָ���ڶ��ηֿ�
-					float lut_diff_max = 1;
-					float lut_diff_min = -1;
-					//��һ����ѩ
-					uvec idx_nosnow_1 = find(((toa_rad_b1_sub_v / 511.72 <= 0.1) || (toa_rad_b2_sub_v / 315.69 <= 0.1) || (toa_rad_b4_sub_v / 593.84 <= 0.11))
-						|| (band3_ref_sub_v <= 0.3));
-					if (idx_nosnow_1.n_elem != 0)
-					{
-						nelem_tiles = idx_nosnow_1.n_elem;
-
-						fvec swdr_sub_v1 = zeros<fvec>(nelem_tiles) - 1.0;
-						fvec sw_dir_sub_v1 = zeros<fvec>(nelem_tiles) - 1.0;
-						fvec par_sub_v1 = zeros<fvec>(nelem_tiles) - 1.0;
-						fvec pardir_sub_v1 = zeros<fvec>(nelem_tiles) - 1.0;
-						fvec uva_sub_v1 = zeros<fvec>(nelem_tiles) - 1.0;
-						fvec uvb_sub_v1 = zeros<fvec>(nelem_tiles) - 1.0;
-						fvec toa_up_flux_sub_v1 = zeros<fvec>(nelem_tiles) - 1.0;
-						fvec rho_sub_v1 = zeros<fvec>(nelem_tiles) - 1.0;
-						//===================================================
-						//��Ӱ����зֿ�
-						fvec dem_sub_v1 = dem_sub_v(idx_nosnow_1);
-						fvec sza_sub_v1 = sza_sub_v(idx_nosnow_1);
-						fvec vza_sub_v1 = vza_sub_v(idx_nosnow_1);
-
-						fvec toa_rad_b1_sub_v1 = toa_rad_b1_sub_v(idx_nosnow_1);
-						fvec toa_rad_b3_sub_v1 = toa_rad_b3_sub_v(idx_nosnow_1);
-						fvec toa_rad_b4_sub_v1 = toa_rad_b4_sub_v(idx_nosnow_1);
-						fvec toa_rad_b6_sub_v1 = toa_rad_b6_sub_v(idx_nosnow_1);
-						fvec toa_rad_b7_sub_v1 = toa_rad_b7_sub_v(idx_nosnow_1);
-
-						fvec band1_ref_sub_v1 = band1_ref_sub_v(idx_nosnow_1);
-						fvec band3_ref_sub_v1 = band3_ref_sub_v(idx_nosnow_1);
-						fvec band4_ref_sub_v1 = band4_ref_sub_v(idx_nosnow_1);
-						fvec band6_ref_sub_v1 = band6_ref_sub_v(idx_nosnow_1);
-						fvec band7_ref_sub_v1 = band7_ref_sub_v(idx_nosnow_1);
-						fvec sw_alb_sub_v1 = sw_alb_sub_v(idx_nosnow_1);
-						fvec vis_alb_sub_v1 = vis_alb_sub_v(idx_nosnow_1);
-
-						////��index�ӱ�����
-						ok = get_SWDR(lut, sza_sub_v1, vza_sub_v1, dem_sub_v1, toa_rad_b1_sub_v1, toa_rad_b3_sub_v1,
-							toa_rad_b4_sub_v1, toa_rad_b6_sub_v1, toa_rad_b7_sub_v1,
-							band1_ref_sub_v1, band3_ref_sub_v1, band4_ref_sub_v1,
-							band6_ref_sub_v1, band7_ref_sub_v1, sw_alb_sub_v1, vis_alb_sub_v1,
-							lut_diff_max, lut_diff_min,
-							swdr_sub_v1, sw_dir_sub_v1,
-							par_sub_v1, pardir_sub_v1, uva_sub_v1, uvb_sub_v1, toa_up_flux_sub_v1, rho_sub_v1);
-						if (ok != 0) continue; // invalid
-
-						//�ѵõ��Ľ��д��ȥ
-						swdr_sub_v(idx_nosnow_1) = swdr_sub_v1;
-						sw_dir_sub_v(idx_nosnow_1) = sw_dir_sub_v1;
-						par_sub_v(idx_nosnow_1) = par_sub_v1;
-						pardir_sub_v(idx_nosnow_1) = pardir_sub_v1;
-						uva_sub_v(idx_nosnow_1) = uva_sub_v1;
-						uvb_sub_v(idx_nosnow_1) = uvb_sub_v1;
-						toa_up_flux_sub_v(idx_nosnow_1) = toa_up_flux_sub_v1;
-						rho_sub_v(idx_nosnow_1) = rho_sub_v1;
-
-						//return 0;
-					}
+			const uvec valid = find(data.slice(0) == 1);
+			if (valid.n_elem == 0) continue;
+
+			fvec sza_v;
+			fvec vza_v;
+			fvec los_v;
+			fvec dem_v;
+			pixel_geometry(data, valid, sza_v, vza_v, los_v, dem_v);
+			const fvec toa_rad_b6_v = valid_pixels(data, 10, valid) / 100.0;
+			const fvec toa_rad_b7_v = valid_pixels(data, 11, valid) / 500.0;
+
+			PixelBins bins;
+			bin_pixels(sza_v, vza_v, los_v, dem_v, toa_rad_b6_v, toa_rad_b7_v,
+				cells.dw_sza_idx, cells.up_sza_idx, cells.dw_vza_idx, cells.up_vza_idx, &cells, bins);
+			binned(bins.cells) += diff(bins.cell_start);
+		}
+	}
+	data.reset();
 
-					//�ڶ�����ѩ
-					uvec idx_nosnow_2 = find((toa_rad_b1_sub_v / 511.72 > 0.1) && (toa_rad_b2_sub_v / 315.69 > 0.1) && (toa_rad_b4_sub_v / 593.84 > 0.11)
-						&& (band3_ref_sub_v > 0.3) && (toa_rad_ndsi_sub_v < 0.1));
+	uvec keys;
+	if (cells.nvalid > 0)
+	{
+		keys = find(binned > 0);
+		uword nretrieved = 0;
+		for (uword ic = 0; ic < keys.n_elem; ic++)
+		{
+			if (cell_retrieved(cells, keys(ic))) keys(nretrieved++) = keys(ic);
+		}
+		keys.resize(nretrieved);
+	}
+	const uvec sizes = binned.n_elem > 0 ? uvec(binned(keys)) : uvec();
+
+	std::vector<uvec> tasks;
+	batch_cells(keys, sizes, sort_index(sizes, "descend"), tasks);
+
+	//a get_SWDR call holds the 8 DEM blocks of each of its cells and GET_SWDR_TILES tiles over its pixels
+	const uword cell_rows = 8 * idx_filter_dem;
+	const double tile_bytes_per_pixel = double(cell_rows) * GET_SWDR_TILES * sizeof(float);
+	const double cell_lut_bytes = double(cell_rows) * LUT_Q_NUM * sizeof(float);
+
+	//a call larger than max_tile_bytes holds the tiles of one chunk at a time
+	const double chunk_bytes = double(chunk_pixels(cell_rows)) * tile_bytes_per_pixel;
+
+	vec task_bytes(tasks.size());
+	for (size_t it = 0; it < tasks.size(); it++)
+		task_bytes(it) = std::min(accu(sizes(tasks[it])) * tile_bytes_per_pixel, chunk_bytes) + tasks[it].n_elem * cell_lut_bytes;
+	const vec largest = sort(task_bytes, "descend");
+	const double peak_tile_bytes = accu(largest.head(std::min<uword>(threads, largest.n_elem)));
+
+	const uvec nodes = node_rows(cells);
+	const double lut_node_bytes = double(nodes.n_elem) * idx_filter_vza * m_lut->n_cols() * m_lut->elem_bytes();
+
+	//a strip in memory: the input bands and the outputs, then about 30 vectors over its valid pixels
+	const double strip_valid = nrows > 0 ? double(cells.nvalid) * strip_rows / nrows : 0;
+	const double strip_bytes = double(strip_rows) * ncols * (reader.n_bands() * sizeof(float) + 10 * sizeof(short) + 8 * sizeof(float))
+		+ strip_valid * 30 * sizeof(float);
+
+	const double row_pixels = double(cell_rows) * accu(sizes);
+	const double cpu_seconds = row_pixels * row_cost_ns * 1.0e-9;
+	const double peak_bytes = strip_bytes + lut_node_bytes + peak_tile_bytes;
+
+	json << "    {\n";
+	json << "      \"file\": " << json_string(input_file) << ",\n";
+	json << "      \"rows\": " << nrows << ", \"cols\": " << ncols << ", \"strip_rows\": " << strip_rows << ",\n";
+	json << "      \"valid_pixels\": " << cells.nvalid << ",\n";
+	if (cells.nvalid > 0)
+	{
+		json << "      \"sza_nodes\": [" << m_sza_list(cells.dw_sza_idx) << ", " << m_sza_list(cells.up_sza_idx) << "],"
+			<< " \"vza_nodes\": [" << m_vza_list(cells.dw_vza_idx) << ", " << m_vza_list(cells.up_vza_idx) << "],\n";
+	}
+	json << "      \"lut_node_rows\": " << nodes.n_elem * idx_filter_vza << ", \"lut_node_bytes\": " << uword(lut_node_bytes) << ",\n";
+	json << "      \"cells\": " << keys.n_elem << ", \"pixels\": " << accu(sizes) << ", \"calls\": " << tasks.size() << ",\n";
+	json << "      \"row_pixels\": " << uword(row_pixels) << ",\n";
+	json << "      \"peak_tile_bytes\": " << uword(peak_tile_bytes) << ", \"peak_bytes\": " << uword(peak_bytes) << ",\n";
+	json << "      \"cpu_seconds\": " << cpu_seconds << ",\n";
+	json << "      \"cell_list\": [";
+	for (uword ic = 0; ic < keys.n_elem; ic++)
+	{
+		const uword key = keys(ic);
+		const uword n = key % cells.n_dem;
+		const uword m = (key / cells.n_dem) % cells.n_los;
+		const uword j = (key / (cells.n_dem * cells.n_los)) % cells.n_vza;
+		const uword i = key / (cells.n_dem * cells.n_los * cells.n_vza);
+
+		json << (ic == 0 ? "\n" : ",\n");
+		json << "        {\"key\": " << key << ", \"sza\": " << m_sza_list(i) << ", \"vza\": " << m_vza_list(j)
+			<< ", \"los\": " << m_los_list_ft(m) << ", \"dem\": " << m_dem_list(n)
+			<< ", \"pixels\": " << sizes(ic) << ", \"lut_rows\": " << cell_rows
+			<< ", \"tile_bytes\": " << uword(std::min(sizes(ic) * tile_bytes_per_pixel, chunk_bytes))
+			<< ", \"cpu_seconds\": " << double(cell_rows) * sizes(ic) * row_cost_ns * 1.0e-9 << "}";
+	}
+	json << "\n      ]\n";
+	json << "    }";
 
-					if (idx_nosnow_2.n_elem != 0)
-					{
-						lut_diff_max = 0.1;
-
-						nelem_tiles = idx_nosnow_2.n_elem;
-
-						fvec swdr_sub_v2 = zeros<fvec>(nelem_tiles) - 1.0;
-						fvec sw_dir_sub_v2 = zeros<fvec>(nelem_tiles) - 1.0;
-						fvec par_sub_v2 = zeros<fvec>(nelem_tiles) - 1.0;
-						fvec pardir_sub_v2 = zeros<fvec>(nelem_tiles) - 1.0;
-						fvec uva_sub_v2 = zeros<fvec>(nelem_tiles) - 1.0;
-						fvec uvb_sub_v2 = zeros<fvec>(nelem_tiles) - 1.0;
-						fvec toa_up_flux_sub_v2 = zeros<fvec>(nelem_tiles) - 1.0;
-						fvec rho_sub_v2 = zeros<fvec>(nelem_tiles) - 1.0;
-						//===================================================
-						//��Ӱ����зֿ�
-						fvec dem_sub_v2 = dem_sub_v(idx_nosnow_2);
-						fvec sza_sub_v2 = sza_sub_v(idx_nosnow_2);
-						fvec vza_sub_v2 = vza_sub_v(idx_nosnow_2);
-
-						fvec toa_rad_b1_sub_v2 = toa_rad_b1_sub_v(idx_nosnow_2);
-						fvec toa_rad_b3_sub_v2 = toa_rad_b3_sub_v(idx_nosnow_2);
-						fvec toa_rad_b4_sub_v2 = toa_rad_b4_sub_v(idx_nosnow_2);
-						fvec toa_rad_b6_sub_v2 = toa_rad_b6_sub_v(idx_nosnow_2);
-						fvec toa_rad_b7_sub_v2 = toa_rad_b7_sub_v(idx_nosnow_2);
-
-						fvec band1_ref_sub_v2 = band1_ref_sub_v(idx_nosnow_2);
-						fvec band3_ref_sub_v2 = band3_ref_sub_v(idx_nosnow_2);
-						fvec band4_ref_sub_v2 = band4_ref_sub_v(idx_nosnow_2);
-						fvec band6_ref_sub_v2 = band6_ref_sub_v(idx_nosnow_2);
-						fvec band7_ref_sub_v2 = band7_ref_sub_v(idx_nosnow_2);
-						fvec sw_alb_sub_v2 = sw_alb_sub_v(idx_nosnow_2);
-						fvec vis_alb_sub_v2 = vis_alb_sub_v(idx_nosnow_2);
-
-						//���һ��LUT�ӱ�����,!!�����ٶ��һ���ܱ����ݣ����һ���Ƕ������£����ӱ��Ҳ������ñ���ʱ���������ܱ��ҿ��ñ���
-						ok = get_SWDR(lut, sza_sub_v2, vza_sub_v2, dem_sub_v2, toa_rad_b1_sub_v2, toa_rad_b3_sub_v2,
-							toa_rad_b4_sub_v2, toa_rad_b6_sub_v2, toa_rad_b7_sub_v2,
-							band1_ref_sub_v2, band3_ref_sub_v2, band4_ref_sub_v2, 
-							band6_ref_sub_v2, band7_ref_sub_v2, sw_alb_sub_v2, vis_alb_sub_v2,
-							lut_diff_max, lut_diff_min,
-							swdr_sub_v2, sw_dir_sub_v2,
-							par_sub_v2, pardir_sub_v2, uva_sub_v2, uvb_sub_v2, toa_up_flux_sub_v2, rho_sub_v2);
-						if (ok != 0) continue; // invalid
-
-						//�ѵõ��Ľ��д��ȥ
-						swdr_sub_v(idx_nosnow_2) = swdr_sub_v2;
-						sw_dir_sub_v(idx_nosnow_2) = sw_dir_sub_v2;
-						par_sub_v(idx_nosnow_2) = par_sub_v2;
-						pardir_sub_v(idx_nosnow_2) = pardir_sub_v2;
-						uva_sub_v(idx_nosnow_2) = uva_sub_v2;
-						uvb_sub_v(idx_nosnow_2) = uvb_sub_v2;
-						toa_up_flux_sub_v(idx_nosnow_2) = toa_up_flux_sub_v2;
-						rho_sub_v(idx_nosnow_2) = rho_sub_v2;
-
-						//return 0;
-					}
+	printf("   valid pixels: %llu, cells: %llu, peak: %.2f GB, CPU: %.1f s\n",
+		(unsigned long long)cells.nvalid, (unsigned long long)keys.n_elem, peak_bytes / 1.0e9, cpu_seconds);
 
-					//��������ѩ (���ü���2����׼�
-					uvec idx_snow_3 = find((toa_rad_b1_sub_v / 511.72 > 0.1) && (toa_rad_b2_sub_v / 315.69 > 0.1) && (toa_rad_b4_sub_v / 593.84 > 0.11)
-						&& (band3_ref_sub_v > 0.3) && (toa_rad_ndsi_sub_v >= 0.1));
+	return 0;
+}
 
-					if (idx_snow_3.n_elem != 0)
-					{
-						nelem_tiles = idx_snow_3.n_elem;
-
-						fvec swdr_sub_v3 = zeros<fvec>(nelem_tiles) - 1.0;
-						fvec sw_dir_sub_v3 = zeros<fvec>(nelem_tiles) - 1.0;
-						fvec par_sub_v3 = zeros<fvec>(nelem_tiles) - 1.0;
-						fvec pardir_sub_v3 = zeros<fvec>(nelem_tiles) - 1.0;
-						fvec uva_sub_v3 = zeros<fvec>(nelem_tiles) - 1.0;
-						fvec uvb_sub_v3 = zeros<fvec>(nelem_tiles) - 1.0;
-						fvec toa_up_flux_sub_v3 = zeros<fvec>(nelem_tiles) - 1.0;
-						fvec rho_sub_v3 = zeros<fvec>(nelem_tiles) - 1.0;
-						//======================================================
-						//��Ӱ����зֿ�
-						fvec dem_sub_v3 = dem_sub_v(idx_snow_3);
-						fvec sza_sub_v3 = sza_sub_v(idx_snow_3);
-						fvec vza_sub_v3 = vza_sub_v(idx_snow_3);
-
-						fvec toa_rad_b1_sub_v3 = toa_rad_b1_sub_v(idx_snow_3);
-						fvec toa_rad_b3_sub_v3 = toa_rad_b3_sub_v(idx_snow_3);
-						fvec toa_rad_b4_sub_v3 = toa_rad_b4_sub_v(idx_snow_3);
-						fvec toa_rad_b6_sub_v3 = toa_rad_b6_sub_v(idx_snow_3);
-						fvec toa_rad_b7_sub_v3 = toa_rad_b7_sub_v(idx_snow_3);
-
-						fvec band1_ref_sub_v3 = band1_ref_sub_v(idx_snow_3);
-						fvec band3_ref_sub_v3 = band3_ref_sub_v(idx_snow_3);
-						fvec band4_ref_sub_v3 = band4_ref_sub_v(idx_snow_3);
-						fvec band6_ref_sub_v3 = band6_ref_sub_v(idx_snow_3);
-						fvec band7_ref_sub_v3 = band7_ref_sub_v(idx_snow_3);
-						fvec sw_alb_sub_v3 = sw_alb_sub_v(idx_snow_3);
-						fvec vis_alb_sub_v3 = vis_alb_sub_v(idx_snow_3);
-
-						fvec toa_rad_ndsi_sub_v3 = toa_rad_ndsi_sub_v(idx_snow_3);
-
-						//------------------------------------------------------------------
-						for (int i = 0; i < 90; i++)
-						{
-							lut_diff_max = i * 0.01 + 0.1;
-							lut_diff_min = i * 0.01 + 0.11;
-							
-							uvec idx_snow_3_i = find(toa_rad_ndsi_sub_v3 >= (i * 0.01 + 0.1) && toa_rad_ndsi_sub_v3 < (i * 0.01 + 0.11));
-							if (idx_snow_3_i.n_elem == 0) continue;
-							
-							//--------------------------------------------------------------
-							nelem_tiles = idx_snow_3_i.n_elem;
-
-							fvec swdr_sub_v3_sub = zeros<fvec>(nelem_tiles) - 1.0;
-							fvec sw_dir_sub_v3_sub = zeros<fvec>(nelem_tiles) - 1.0;
-							fvec par_sub_v3_sub = zeros<fvec>(nelem_tiles) - 1.0;
-							fvec pardir_sub_v3_sub = zeros<fvec>(nelem_tiles) - 1.0;
-							fvec uva_sub_v3_sub = zeros<fvec>(nelem_tiles) - 1.0;
-							fvec uvb_sub_v3_sub = zeros<fvec>(nelem_tiles) - 1.0;
-							fvec toa_up_flux_sub_v3_sub = zeros<fvec>(nelem_tiles) - 1.0;
-							fvec rho_sub_v3_sub = zeros<fvec>(nelem_tiles) - 1.0;
-							//======================================================
-
-							//��Ӱ����зֿ�
-							fvec dem_sub_v3_sub = dem_sub_v3(idx_snow_3_i);
-							fvec sza_sub_v3_sub = sza_sub_v3(idx_snow_3_i);
-							fvec vza_sub_v3_sub = vza_sub_v3(idx_snow_3_i);
-
-							fvec toa_rad_b1_sub_v3_sub = toa_rad_b1_sub_v3(idx_snow_3_i);
-							fvec toa_rad_b3_sub_v3_sub = toa_rad_b3_sub_v3(idx_snow_3_i);
-							fvec toa_rad_b4_sub_v3_sub = toa_rad_b4_sub_v3(idx_snow_3_i);
-							fvec toa_rad_b6_sub_v3_sub = toa_rad_b6_sub_v3(idx_snow_3_i);
-							fvec toa_rad_b7_sub_v3_sub = toa_rad_b7_sub_v3(idx_snow_3_i);
-
-							fvec band1_ref_sub_v3_sub = band1_ref_sub_v3(idx_snow_3_i);
-							fvec band3_ref_sub_v3_sub = band3_ref_sub_v3(idx_snow_3_i);
-							fvec band4_ref_sub_v3_sub = band4_ref_sub_v3(idx_snow_3_i);
-							fvec band6_ref_sub_v3_sub = band6_ref_sub_v3(idx_snow_3_i);
-							fvec band7_ref_sub_v3_sub = band7_ref_sub_v3(idx_snow_3_i);
-							fvec sw_alb_sub_v3_sub = sw_alb_sub_v3(idx_snow_3_i);
-							fvec vis_alb_sub_v3_sub = vis_alb_sub_v3(idx_snow_3_i);
-
-							//��index�ӱ�����
-							ok = get_SWDR(lut, sza_sub_v3_sub, vza_sub_v3_sub, dem_sub_v3_sub, toa_rad_b1_sub_v3_sub, toa_rad_b3_sub_v3_sub,
-								toa_rad_b4_sub_v3_sub, toa_rad_b6_sub_v3_sub, toa_rad_b7_sub_v3_sub,
-								band1_ref_sub_v3_sub, band3_ref_sub_v3_sub, band4_ref_sub_v3_sub,
-								band6_ref_sub_v3_sub, band7_ref_sub_v3_sub, sw_alb_sub_v3_sub, vis_alb_sub_v3_sub,
-								lut_diff_max, lut_diff_min,
-								swdr_sub_v3_sub, sw_dir_sub_v3_sub,
-								par_sub_v3_sub, pardir_sub_v3_sub, uva_sub_v3_sub, uvb_sub_v3_sub, toa_up_flux_sub_v3_sub, rho_sub_v3_sub);
-							if (ok != 0) continue; // invalid
-
-							//�ѵõ��Ľ��д��ȥ
-							swdr_sub_v3(idx_snow_3_i) = swdr_sub_v3_sub;
-							sw_dir_sub_v3(idx_snow_3_i) = sw_dir_sub_v3_sub;
-							par_sub_v3(idx_snow_3_i) = par_sub_v3_sub;
-							pardir_sub_v3(idx_snow_3_i) = pardir_sub_v3_sub;
-							uva_sub_v3(idx_snow_3_i) = uva_sub_v3_sub;
-							uvb_sub_v3(idx_snow_3_i) = uvb_sub_v3_sub;
-							toa_up_flux_sub_v3(idx_snow_3_i) = toa_up_flux_sub_v3_sub;
-							rho_sub_v3(idx_snow_3_i) = rho_sub_v3_sub;
-
-							//return 0;
-						}
-
-						//�ѵõ��Ľ��д��ȥ
-						swdr_sub_v(idx_snow_3) = swdr_sub_v3;
-						sw_dir_sub_v(idx_snow_3) = sw_dir_sub_v3;
-						par_sub_v(idx_snow_3) = par_sub_v3;
-						pardir_sub_v(idx_snow_3) = pardir_sub_v3;
-						uva_sub_v(idx_snow_3) = uva_sub_v3;
-						uvb_sub_v(idx_snow_3) = uvb_sub_v3;
-						toa_up_flux_sub_v(idx_snow_3) = toa_up_flux_sub_v3;
-						rho_sub_v(idx_snow_3) = rho_sub_v3;
-					}
 
-					//==================================================================================
-					//���Ƕȷֿ���д��ȥ
-					swdr_v(idx_tile) = swdr_sub_v;
-					sw_dir_v(idx_tile) = sw_dir_sub_v;
-					par_v(idx_tile) = par_sub_v;
-					pardir_v(idx_tile) = pardir_sub_v;
-					uva_v(idx_tile) = uva_sub_v;
-					uvb_v(idx_tile) = uvb_sub_v;
-					toa_up_flux_v(idx_tile) = toa_up_flux_sub_v;
-					rho_v(idx_tile) = rho_sub_v;
+void ahi_swdr::count_cells(const arma::fcube& data, ImageCells& cells) const
+{
+	using namespace arma;
 
-				} // end m,LOS
+	const uvec valid = find(data.slice(0) == 1);
+	if (valid.n_elem == 0) return;
 
-			} // end m,LOS
-			
-		} // end j,VZA
+	fvec sza_v;
+	fvec vza_v;
+	fvec los_v;
+	fvec dem_v;
+	pixel_geometry(data, valid, sza_v, vza_v, los_v, dem_v);
+	const fvec toa_rad_b6_v = valid_pixels(data, 10, valid) / 100.0;
+	const fvec toa_rad_b7_v = valid_pixels(data, 11, valid) / 500.0;
 
-	} // end i,SZA
+	//all the SZA/VZA cells: the nodes of the image are only known after its last strip,
+	//the cells outside them are then left out by retrieve_strip
+	PixelBins bins;
+	bin_pixels(sza_v, vza_v, los_v, dem_v, toa_rad_b6_v, toa_rad_b7_v,
+		0, m_sza_list.n_elem - 1, 0, m_vza_list.n_elem - 1, nullptr, bins);
 
-	//һά���ά
-	swdr_mat = reshape(swdr_v, nrows, ncols);
-	sw_dir_mat = reshape(sw_dir_v, nrows, ncols);
-	par_mat = reshape(par_v, nrows, ncols);
-	pardir_mat = reshape(pardir_v, nrows, ncols);
+	if (cells.nvalid == 0)
+	{
+		cells.sza_min = sza_v.min();
+		cells.sza_max = sza_v.max();
+		cells.vza_min = vza_v.min();
+		cells.vza_max = vza_v.max();
+		cells.n_sza = bins.n_sza;
+		cells.n_vza = bins.n_vza;
+		cells.n_los = bins.n_los;
+		cells.n_dem = bins.n_dem;
+		cells.sza_vza_count.zeros(bins.sza_vza_count.n_elem);
+		cells.los_count.zeros(bins.los_count.n_elem);
+		cells.cell_count.zeros(bins.n_sza * bins.n_vza * bins.n_los * bins.n_dem);
+	}
+	else
+	{
+		cells.sza_min = std::min(cells.sza_min, sza_v.min());
+		cells.sza_max = std::max(cells.sza_max, sza_v.max());
+		cells.vza_min = std::min(cells.vza_min, vza_v.min());
+		cells.vza_max = std::max(cells.vza_max, vza_v.max());
+	}
 
-	uva_mat = reshape(uva_v, nrows, ncols);
-	uvb_mat = reshape(uvb_v, nrows, ncols);
-	toa_up_flux_mat = reshape(toa_up_flux_v, nrows, ncols);
-	rho_mat = reshape(rho_v, nrows, ncols);
+	cells.nvalid += valid.n_elem;
+	cells.sza_vza_count += bins.sza_vza_count;
+	cells.los_count += bins.los_count;
+	cells.cell_count += bins.cell_count;
+}
 
-	cout << "-> " << " image time: " << timer.toc() << " seconds." << endl;
 
-	cout << "To estimate SWDR has been finished.\n";
+int ahi_swdr::locate_cells(ImageCells& cells) const
+{
+	using namespace arma;
+
+	//SZA/VZA nodes around the valid pixels, the image gives -1 everywhere without them
+	if (cells.nvalid == 0) return 0;
+
+	int flag = filter_sza(cells.sza_min, cells.sza_max, cells.up_sza_idx, cells.dw_sza_idx, m_sza_list_ft, m_sza_min, m_sza_max);
+	if (flag != 0) return 1;
+
+	flag = filter_sza(cells.vza_min, cells.vza_max, cells.up_vza_idx, cells.dw_vza_idx, m_vza_list_ft, m_vza_min, m_vza_max);
+	if (flag != 0) return 1;
+
+	return 0;
+}
+
+
+arma::uvec ahi_swdr::node_rows(const ImageCells& cells) const
+{
+	using namespace arma;
+
+	if (cells.nvalid == 0) return uvec();
+
+	//the rows of one node are contiguous in the LUT
+	uvec rows((cells.up_sza_idx - cells.dw_sza_idx + 1) * (cells.up_vza_idx - cells.dw_vza_idx + 1));
+	uword in = 0;
+	for (uword i = cells.dw_sza_idx; i <= cells.up_sza_idx; i++)
+	{
+		for (uword j = cells.dw_vza_idx; j <= cells.up_vza_idx; j++)
+		{
+			rows(in++) = i * idx_filter_sza + j * idx_filter_vza;
+		}
+	}
+	return rows;
+}
+
+
+bool ahi_swdr::cell_retrieved(const ImageCells& cells, arma::uword key) const
+{
+	using namespace arma;
+
+	const uword m = (key / cells.n_dem) % cells.n_los;
+	const uword j = (key / (cells.n_dem * cells.n_los)) % cells.n_vza;
+	const uword i = key / (cells.n_dem * cells.n_los * cells.n_vza);
+
+	if (i < cells.dw_sza_idx || i >= cells.up_sza_idx) return false;
+	if (j < cells.dw_vza_idx || j >= cells.up_vza_idx) return false;
+	if (cells.sza_vza_count(i * cells.n_vza + j) < 5) return false;
+	if (cells.los_count((i * cells.n_vza + j) * cells.n_los + m) < 5) return false;
+	return cells.cell_count(key) >= 5;
+}
+
+
+void ahi_swdr::batch_cells(const arma::uvec& keys, const arma::uvec& sizes, const arma::uvec& order,
+	std::vector<arma::uvec>& tasks) const
+{
+	using namespace arma;
+
+	tasks.clear();
+	std::vector<uword> batch;
+	uword batch_pixels = 0;
+	for (uword io = 0; io < order.n_elem; io++)
+	{
+		const uword ic = order(io);
+		if (sizes(ic) >= m_cell_batch_pixels)
+		{
+			tasks.push_back(uvec{ ic });
+			continue;
+		}
+		if (batch_pixels + sizes(ic) > m_cell_batch_pixels)
+		{
+			tasks.push_back(conv_to<uvec>::from(batch));
+			batch.clear();
+			batch_pixels = 0;
+		}
+		batch.push_back(ic);
+		batch_pixels += sizes(ic);
+	}
+	if (!batch.empty()) tasks.push_back(conv_to<uvec>::from(batch));
+}
+
+
+int ahi_swdr::retrieve_strip(arma::fcube& data, const ImageCells& cells, arma::Cube<short>& fluxes) const
+{
+	using namespace std;
+	using namespace arma;
+
+	//hdf
+	const uword nrows = data.n_rows;
+	const uword ncols = data.n_cols;
+
+	//ingestion: the pixels with flag 1 are compacted once, all the *_v vectors below hold these pixels only;
+	//the results are scattered back into the -1 filled images at the end
+	const uvec valid = find(data.slice(0) == 1);
+	const uword nvalid = valid.n_elem;
+
+	//whole images written to the output file
+	const fmat sza_mat = data.slice(1) / 100.0; // in degree
+	const fmat sw_alb_mat = data.slice(19) / 1000.0;
 
-	//***********************************************************
+	fvec sza_mat_v;
+	fvec vza_mat_v;
+	fvec los_mat_v;
+	fvec dem_mat_v;
+	pixel_geometry(data, valid, sza_mat_v, vza_mat_v, los_mat_v, dem_mat_v);
+
+	fvec toa_rad_mat_b1_v = valid_pixels(data, 7, valid) / 10.0;
+	fvec toa_rad_mat_b2_v = valid_pixels(data, 8, valid) / 10.0;
+	fvec toa_rad_mat_b3_v = valid_pixels(data, 5, valid) / 10.0; //toa_rad_mat
+	fvec toa_rad_mat_b4_v = valid_pixels(data, 6, valid) / 10.0;
+	fvec toa_rad_mat_b5_v = valid_pixels(data, 9, valid) / 100.0;
+	fvec toa_rad_mat_b6_v = valid_pixels(data, 10, valid) / 100.0;
+	fvec toa_rad_mat_b7_v = valid_pixels(data, 11, valid) / 500.0;
+
+	fvec band1_ref_mat_v = valid_pixels(data, 12, valid) / 1000.0;
+	fvec band2_ref_mat_v = valid_pixels(data, 13, valid) / 1000.0;
+	fvec band3_ref_mat_v = valid_pixels(data, 14, valid) / 1000.0; //blue_ref_mat
+	fvec band4_ref_mat_v = valid_pixels(data, 15, valid) / 1000.0;
+	fvec band5_ref_mat_v = valid_pixels(data, 16, valid) / 1000.0;
+	fvec band6_ref_mat_v = valid_pixels(data, 17, valid) / 1000.0;
+	fvec band7_ref_mat_v = valid_pixels(data, 18, valid) / 1000.0;
+
+	fvec sw_alb_mat_v = sw_alb_mat(valid);
+	fvec vis_alb_mat_v = valid_pixels(data, 20, valid) / 1000.0;
+
+	//the input image is no longer needed
+	data.reset();
 
-	Cube<short> fluxes = zeros<Cube<short>>(nrows, ncols, 10);
+	// -1 for invalid data
+	fvec swdr_v = zeros<fvec>(nvalid) - 1.0;
+	fvec sw_dir_v = zeros<fvec>(nvalid) - 1.0;
+	fvec par_v = zeros<fvec>(nvalid) - 1.0;
+	fvec pardir_v = zeros<fvec>(nvalid) - 1.0;
+	fvec uva_v = zeros<fvec>(nvalid) - 1.0;
+	fvec uvb_v = zeros<fvec>(nvalid) - 1.0;
+	fvec toa_up_flux_v = zeros<fvec>(nvalid) - 1.0;
+	fvec rho_v = zeros<fvec>(nvalid) - 1.0;
+
+	PixelBins bins;
+	bin_pixels(sza_mat_v, vza_mat_v, los_mat_v, dem_mat_v, toa_rad_mat_b6_v, toa_rad_mat_b7_v,
+		cells.dw_sza_idx, cells.up_sza_idx, cells.dw_vza_idx, cells.up_vza_idx, &cells, bins);
+
+	//----------------------------------------
+	//occupied (SZA, VZA, LOS, DEM) cells with at least 5 pixels of the image in the SZA/VZA cell, in its LOS cell and in the DEM cell
+	const uvec cell_size = diff(bins.cell_start);
+	uvec retrieved_cells(cell_size.n_elem);
+	uword nretrieved = 0;
+	for (uword ic = 0; ic < cell_size.n_elem; ic++)
+	{
+		if (cell_retrieved(cells, bins.cells(ic))) retrieved_cells(nretrieved++) = ic;
+	}
+	retrieved_cells.resize(nretrieved);
+	const uvec cell_order = retrieved_cells(sort_index(cell_size(retrieved_cells), "descend"));
+
+	//one task per cell and the largest cells first; the cells with fewer than cell_batch_pixels pixels
+	//are retrieved together, up to cell_batch_pixels pixels per task
+	std::vector<uvec> tasks;
+	batch_cells(bins.cells, cell_size, cell_order, tasks);
+
+	//retrieve the cells of a task with one get_SWDR call per class; 1 if a call fails,
+	//the pixels of the cells are then left invalid. LUT rows that cannot be read fail the strip
+	std::atomic<bool> lut_failed{ false };
+	auto retrieve_cells = [&](const uvec& task_cells)
+	{
+		PreparedCellLut lut;
+		if (prepare_cell_lut(bins, task_cells, lut) != 0)
+		{
+			lut_failed = true;
+			return 1;
+		}
+
+		//pixels of the cells, pixel_cell_v = slice of the cell of each pixel in lut
+		uword npixels = 0;
+		for (uword c = 0; c < task_cells.n_elem; c++)
+			npixels += cell_size(task_cells(c));
+
+		uvec idx_tile(npixels);
+		uvec pixel_cell_v(npixels);
+		uword ip = 0;
+		for (uword c = 0; c < task_cells.n_elem; c++)
+		{
+			for (uword k = bins.cell_start(task_cells(c)); k < bins.cell_start(task_cells(c) + 1); k++)
+			{
+				idx_tile(ip) = bins.pixels(k);
+				pixel_cell_v(ip) = c;
+				ip++;
+			}
+		}
+
+		////�Բ��ұ����зֿ�
+		//=============��һ�ηֿ�==================================================================
+		//��Ӱ����зֿ�
+		fvec dem_sub_v = dem_mat_v(idx_tile);
+		fvec sza_sub_v = sza_mat_v(idx_tile);
+		fvec vza_sub_v = vza_mat_v(idx_tile);
+
+		fvec toa_rad_b1_sub_v = toa_rad_mat_b1_v(idx_tile);
+		fvec toa_rad_b2_sub_v = toa_rad_mat_b2_v(idx_tile);
+	    fvec toa_rad_b3_sub_v = toa_rad_mat_b3_v(idx_tile);
+		fvec toa_rad_b4_sub_v = toa_rad_mat_b4_v(idx_tile);
+		fvec toa_rad_b5_sub_v = toa_rad_mat_b5_v(idx_tile);
+		fvec toa_rad_b6_sub_v = toa_rad_mat_b6_v(idx_tile);
+		fvec toa_rad_b7_sub_v = toa_rad_mat_b7_v(idx_tile);
+
+		fvec toa_rad_ndsi_sub_v = (toa_rad_b4_sub_v / 593.84 - toa_rad_b6_sub_v / 76.53) / (toa_rad_b4_sub_v / 593.84 + toa_rad_b6_sub_v / 76.53);
+
+		fvec band1_ref_sub_v = band1_ref_mat_v(idx_tile);
+		fvec band2_ref_sub_v = band2_ref_mat_v(idx_tile);
+		fvec band3_ref_sub_v = band3_ref_mat_v(idx_tile);
+		fvec band4_ref_sub_v = band4_ref_mat_v(idx_tile);
+		fvec band5_ref_sub_v = band5_ref_mat_v(idx_tile);
+		fvec band6_ref_sub_v = band6_ref_mat_v(idx_tile);
+		fvec band7_ref_sub_v = band7_ref_mat_v(idx_tile);
+		fvec sw_alb_sub_v = sw_alb_mat_v(idx_tile);
+		fvec vis_alb_sub_v = vis_alb_mat_v(idx_tile);
+
+		uword nelem_tiles = toa_rad_b3_sub_v.n_elem;
+
+		fvec swdr_sub_v = zeros<fvec>(nelem_tiles) - 1.0;
+		fvec sw_dir_sub_v = zeros<fvec>(nelem_tiles) - 1.0;
+		fvec par_sub_v = zeros<fvec>(nelem_tiles) - 1.0;
+		fvec pardir_sub_v = zeros<fvec>(nelem_tiles) - 1.0;
+		fvec uva_sub_v = zeros<fvec>(nelem_tiles) - 1.0;
+		fvec uvb_sub_v = zeros<fvec>(nelem_tiles) - 1.0;
+		fvec toa_up_flux_sub_v = zeros<fvec>(nelem_tiles) - 1.0;
+		fvec rho_sub_v = zeros<fvec>(nelem_tiles) - 1.0;
+
+		//retrieve the pixels idx of the cell, the LUT rows of a pixel are selected with its own NDSI window
+		//[lut_diff_min, lut_diff_max]; 1 if get_SWDR fails, the pixels are then left invalid
+		auto retrieve_pixels = [&](const uvec& idx, const fvec& lut_diff_max, const fvec& lut_diff_min)
+		{
+			const uword npixels = idx.n_elem;
+
+			fvec swdr_sub = zeros<fvec>(npixels) - 1.0;
+			fvec sw_dir_sub = zeros<fvec>(npixels) - 1.0;
+			fvec par_sub = zeros<fvec>(npixels) - 1.0;
+			fvec pardir_sub = zeros<fvec>(npixels) - 1.0;
+			fvec uva_sub = zeros<fvec>(npixels) - 1.0;
+			fvec uvb_sub = zeros<fvec>(npixels) - 1.0;
+			fvec toa_up_flux_sub = zeros<fvec>(npixels) - 1.0;
+			fvec rho_sub = zeros<fvec>(npixels) - 1.0;
+			//===================================================
+			//��Ӱ����зֿ�
+			fvec dem_sub = dem_sub_v(idx);
+			fvec sza_sub = sza_sub_v(idx);
+			fvec vza_sub = vza_sub_v(idx);
+
+			fvec toa_rad_b1_sub = toa_rad_b1_sub_v(idx);
+			fvec toa_rad_b3_sub = toa_rad_b3_sub_v(idx);
+			fvec toa_rad_b4_sub = toa_rad_b4_sub_v(idx);
+			fvec toa_rad_b6_sub = toa_rad_b6_sub_v(idx);
+			fvec toa_rad_b7_sub = toa_rad_b7_sub_v(idx);
+
+			fvec band1_ref_sub = band1_ref_sub_v(idx);
+			fvec band3_ref_sub = band3_ref_sub_v(idx);
+			fvec band4_ref_sub = band4_ref_sub_v(idx);
+			fvec band6_ref_sub = band6_ref_sub_v(idx);
+			fvec band7_ref_sub = band7_ref_sub_v(idx);
+			fvec sw_alb_sub = sw_alb_sub_v(idx);
+			fvec vis_alb_sub = vis_alb_sub_v(idx);
+
+			const int ok = get_SWDR(lut, pixel_cell_v(idx), sza_sub, vza_sub, dem_sub, toa_rad_b1_sub, toa_rad_b3_sub,
+				toa_rad_b4_sub, toa_rad_b6_sub, toa_rad_b7_sub,
+				band1_ref_sub, band3_ref_sub, band4_ref_sub,
+				band6_ref_sub, band7_ref_sub, sw_alb_sub, vis_alb_sub,
+				lut_diff_max, lut_diff_min,
+				swdr_sub, sw_dir_sub,
+				par_sub, pardir_sub, uva_sub, uvb_sub, toa_up_flux_sub, rho_sub);
+			if (ok != 0) return 1; // invalid
+
+			//�ѵõ��Ľ��д��ȥ
+			swdr_sub_v(idx) = swdr_sub;
+			sw_dir_sub_v(idx) = sw_dir_sub;
+			par_sub_v(idx) = par_sub;
+			pardir_sub_v(idx) = pardir_sub;
+			uva_sub_v(idx) = uva_sub;
+			uvb_sub_v(idx) = uvb_sub;
+			toa_up_flux_sub_v(idx) = toa_up_flux_sub;
+			rho_sub_v(idx) = rho_sub;
+			return 0;
+		};
+
+		////================================================================================================================
+		//���ݻ�ѩָ���ڶ��ηֿ�
+		//��һ����ѩ
+		uvec idx_nosnow_1 = find(((toa_rad_b1_sub_v / 511.72 <= 0.1) || (toa_rad_b2_sub_v / 315.69 <= 0.1) || (toa_rad_b4_sub_v / 593.84 <= 0.11))
+			|| (band3_ref_sub_v <= 0.3));
+		if (idx_nosnow_1.n_elem != 0)
+		{
+			nelem_tiles = idx_nosnow_1.n_elem;
+			if (retrieve_pixels(idx_nosnow_1, zeros<fvec>(nelem_tiles) + 1.0, zeros<fvec>(nelem_tiles) - 1.0) != 0) return 1; // invalid
+		}
+
+		//�ڶ�����ѩ
+		uvec idx_nosnow_2 = find((toa_rad_b1_sub_v / 511.72 > 0.1) && (toa_rad_b2_sub_v / 315.69 > 0.1) && (toa_rad_b4_sub_v / 593.84 > 0.11)
+			&& (band3_ref_sub_v > 0.3) && (toa_rad_ndsi_sub_v < 0.1));
+		if (idx_nosnow_2.n_elem != 0)
+		{
+			nelem_tiles = idx_nosnow_2.n_elem;
+			if (retrieve_pixels(idx_nosnow_2, zeros<fvec>(nelem_tiles) + 0.1, zeros<fvec>(nelem_tiles) - 1.0) != 0) return 1; // invalid
+		}
+
+		//��������ѩ (���ü���2����׼�
+		uvec idx_snow_3 = find((toa_rad_b1_sub_v / 511.72 > 0.1) && (toa_rad_b2_sub_v / 315.69 > 0.1) && (toa_rad_b4_sub_v / 593.84 > 0.11)
+			&& (band3_ref_sub_v > 0.3) && (toa_rad_ndsi_sub_v >= 0.1));
+
+		//NDSI window of every snow pixel, one pass instead of a search per window; NDSI >= 1 stays invalid
+		uvec snow_bin(idx_snow_3.n_elem);
+		for (uword k = 0; k < idx_snow_3.n_elem; k++)
+			snow_bin(k) = snow_ndsi_bin(toa_rad_ndsi_sub_v(idx_snow_3(k)));
+		const uvec in_window = find(snow_bin < SNOW_NDSI_BINS);
+		idx_snow_3 = idx_snow_3(in_window);
+		snow_bin = snow_bin(in_window);
+
+		if (idx_snow_3.n_elem != 0)
+		{
+			nelem_tiles = idx_snow_3.n_elem;
+			fvec lut_diff_max(nelem_tiles);
+			fvec lut_diff_min(nelem_tiles);
+			for (uword k = 0; k < nelem_tiles; k++)
+			{
+				lut_diff_max(k) = snow_bin(k) * 0.01 + 0.1;
+				lut_diff_min(k) = snow_bin(k) * 0.01 + 0.11;
+			}
+
+			//all the cells and windows in one call; a pixel failing get_SWDR only invalidates its own window
+			//of its own cell, so each window of each cell is retried alone then, the pixels sorted once
+			if (retrieve_pixels(idx_snow_3, lut_diff_max, lut_diff_min) != 0)
+			{
+				const uvec cell_bin = pixel_cell_v(idx_snow_3) * SNOW_NDSI_BINS + snow_bin;
+				const uvec order = stable_sort_index(cell_bin);
+				uword st = 0;
+				while (st < order.n_elem)
+				{
+					uword ed = st;
+					while (ed + 1 < order.n_elem && cell_bin(order(ed + 1)) == cell_bin(order(st)))
+						ed++;
+
+					const uvec window = order.subvec(st, ed);
+					retrieve_pixels(idx_snow_3(window), lut_diff_max(window), lut_diff_min(window));
+					st = ed + 1;
+				}
+			}
+		}
+
+		//==================================================================================
+		//���Ƕȷֿ���д��ȥ
+		swdr_v(idx_tile) = swdr_sub_v;
+		sw_dir_v(idx_tile) = sw_dir_sub_v;
+		par_v(idx_tile) = par_sub_v;
+		pardir_v(idx_tile) = pardir_sub_v;
+		uva_v(idx_tile) = uva_sub_v;
+		uvb_v(idx_tile) = uvb_sub_v;
+		toa_up_flux_v(idx_tile) = toa_up_flux_sub_v;
+		rho_v(idx_tile) = rho_sub_v;
+
+		return 0;
+	};
+
+	//a pixel belongs to one cell, so the tasks write disjoint elements of the outputs
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, tasks.size(), 1),
+		[&](const tbb::blocked_range<size_t>& br)
+	{
+		for (size_t it = br.begin(); it != br.end(); it++)
+		{
+			//a failing batch is retried cell by cell, so that only the failing cells are lost
+			if (retrieve_cells(tasks[it]) != 0 && tasks[it].n_elem > 1)
+			{
+				for (uword c = 0; c < tasks[it].n_elem; c++)
+					retrieve_cells(uvec{ tasks[it](c) });
+			}
+		}
+	}, tbb::simple_partitioner()); // end parallel_for
+
+	if (lut_failed)
+	{
+		cout << "[Error] cannot read the LUT rows of the cells\n";
+		return 1;
+	}
+
+	//scatter the valid pixels into the images, -1 for invalid data
+	fmat swdr_mat = zeros<fmat>(nrows, ncols) - 1.0;
+	fmat sw_dir_mat = zeros<fmat>(nrows, ncols) - 1.0;
+	fmat par_mat = zeros<fmat>(nrows, ncols) - 1.0;
+	fmat pardir_mat = zeros<fmat>(nrows, ncols) - 1.0;
+	fmat uva_mat = zeros<fmat>(nrows, ncols) - 1.0;
+	fmat uvb_mat = zeros<fmat>(nrows, ncols) - 1.0;
+	fmat toa_up_flux_mat = zeros<fmat>(nrows, ncols) - 1.0;
+	fmat rho_mat = zeros<fmat>(nrows, ncols) - 1.0;
+	swdr_mat(valid) = swdr_v;
+	sw_dir_mat(valid) = sw_dir_v;
+	par_mat(valid) = par_v;
+	pardir_mat(valid) = pardir_v;
+	uva_mat(valid) = uva_v;
+	uvb_mat(valid) = uvb_v;
+	toa_up_flux_mat(valid) = toa_up_flux_v;
+	rho_mat(valid) = rho_v;
+
+	fluxes = zeros<Cube<short>>(nrows, ncols, 10);
 	fluxes.slice(0) = conv_to<Mat<short>>::from(swdr_mat * 10);
 	fluxes.slice(1) = conv_to<Mat<short>>::from(sw_dir_mat * 10);
 	fluxes.slice(2) = conv_to<Mat<short>>::from(par_mat * 10);
@@ -758,24 +1082,12 @@ int ahi_swdr::retrieve_image(const std::string& input_file, const std::string& o
 	fluxes.slice(8) = conv_to<Mat<short>>::from(sw_alb_mat * 10000);  //�ر������η����ʣ������ٽ�ЧӦ����
 	fluxes.slice(9) = conv_to<Mat<short>>::from(sza_mat * 100);       //scale_factor = 0.01
 
-	imageGeoInfo geoinfo{ input_file };
-	ok = write_3d_geotif(fluxes, geoinfo, out_file);
-	if (ok != 0) return 1;
-
-	fs::path mypath{ out_file };
-	if (!fs::exists(out_file))
-	{
-		cerr << "cannot find output file: " << out_file << endl;
-		return 1;
-	}
-
-	cout << "Save SWDR MODIS to file: " << out_file << endl;
 	return 0;
 }
 
 int ahi_swdr::classify_atmos(arma::fmat& toa_rad_band1_lut, arma::fmat& toa_rad_band3_lut, arma::fmat& toa_rad_band6_lut, arma::fmat& toa_rad_band7_lut,
 	arma::fmat& toa_rad_band1_lut_clear, arma::fmat& toa_rad_band3_lut_clear, arma::fmat& toa_rad_band6_lut_clear, arma::fmat& toa_rad_band7_lut_clear,
-	arma::fmat& toa_rad_band1_lut_cloudy, arma::fmat& toa_rad_band3_lut_cloudy, arma::fmat& toa_rad_band7_lut_cloudy)
+	arma::fmat& toa_rad_band1_lut_cloudy, arma::fmat& toa_rad_band3_lut_cloudy, arma::fmat& toa_rad_band7_lut_cloudy) const
 {
 	using namespace std;
 	using namespace arma;
@@ -796,9 +1108,7 @@ int ahi_swdr::classify_atmos(arma::fmat& toa_rad_band1_lut, arma::fmat& toa_rad_
 	//--MODIS--//
 	//uword idx_clear_st = 36; 
 	//uword idx_clear_ed = 41;
-	//--FY-3D--//
-	uword idx_clear_st = 72;
-	uword idx_clear_ed = 77;
+	//--FY-3D--// 72, 77, from the LUT header
 
 	//band1
 	fmat toa_rad_b1_clear = mean(toa_rad_band1_lut.rows(span(idx_us_uv_ud + idx_clear_st, idx_us_uv_ud + idx_clear_ed)));
@@ -967,7 +1277,7 @@ int ahi_swdr::classify_atmos(arma::fmat& toa_rad_band1_lut, arma::fmat& toa_rad_
 	//===================================================================
 	//����
 	//uvec idx_cloudy = { 207,221,235 };//modis
-	uvec idx_cloudy = { 243,257,271 }; //FY-3D��������յ�vis
+	//uvec idx_cloudy = { 243,257,271 }; //FY-3D��������յ�vis
 	//------------------------------------------
 
 	//band1
@@ -1097,14 +1407,87 @@ int ahi_swdr::classify_atmos(arma::fmat& toa_rad_band1_lut, arma::fmat& toa_rad_
 }
 
 
-int ahi_swdr::get_SWDR(arma::fmat lut, arma::fvec& sza_sub_v, arma::fvec& vza_sub_v, arma::fvec& dem_sub_v,
+arma::uword ahi_swdr::chunk_pixels(arma::uword lut_rows) const
+{
+	if (m_max_tile_bytes == 0) return std::numeric_limits<arma::uword>::max();
+
+	const double tile_bytes_per_pixel = double(lut_rows) * GET_SWDR_TILES * sizeof(float);
+	return std::max<arma::uword>(1, arma::uword(m_max_tile_bytes / tile_bytes_per_pixel));
+}
+
+
+int ahi_swdr::get_SWDR(const PreparedCellLut& lut, const arma::uvec& pixel_cell, arma::fvec& sza_sub_v, arma::fvec& vza_sub_v, arma::fvec& dem_sub_v,
+	arma::fvec& toa_rad_b1_sub_v, arma::fvec& toa_rad_b3_sub_v, arma::fvec& toa_rad_b4_sub_v, arma::fvec& toa_rad_b6_sub_v, arma::fvec& toa_rad_b7_sub_v,
+	arma::fvec& band1_ref_sub_v, arma::fvec& band3_ref_sub_v, arma::fvec& band4_ref_sub_v, arma::fvec& band6_ref_sub_v, arma::fvec& band7_ref_sub_v,
+	arma::fvec& sw_albedo_sub_v, arma::fvec& vis_albedo_sub_v,
+	const arma::fvec& lut_diff_max, const arma::fvec& lut_diff_min,
+	arma::fvec& derived_swdr, arma::fvec& derived_dir, arma::fvec& derived_par, arma::fvec& derived_pardir,
+	arma::fvec& derived_uva, arma::fvec& derived_uvb,
+	arma::fvec& derived_toa_up_flux, arma::fvec& derived_rho) const
+{
+	using namespace arma;
+
+	const uword npixels = pixel_cell.n_elem;
+	const uword chunk = chunk_pixels(lut.quantities.n_rows);
+	if (npixels <= chunk)
+	{
+		return get_SWDR_chunk(lut, pixel_cell, sza_sub_v, vza_sub_v, dem_sub_v,
+			toa_rad_b1_sub_v, toa_rad_b3_sub_v, toa_rad_b4_sub_v, toa_rad_b6_sub_v, toa_rad_b7_sub_v,
+			band1_ref_sub_v, band3_ref_sub_v, band4_ref_sub_v, band6_ref_sub_v, band7_ref_sub_v,
+			sw_albedo_sub_v, vis_albedo_sub_v, lut_diff_max, lut_diff_min,
+			derived_swdr, derived_dir, derived_par, derived_pardir, derived_uva, derived_uvb,
+			derived_toa_up_flux, derived_rho);
+	}
+
+	//every pixel is retrieved on its own, so the chunks give the results of one call
+	const fvec* inputs[] = { &sza_sub_v, &vza_sub_v, &dem_sub_v,
+		&toa_rad_b1_sub_v, &toa_rad_b3_sub_v, &toa_rad_b4_sub_v, &toa_rad_b6_sub_v, &toa_rad_b7_sub_v,
+		&band1_ref_sub_v, &band3_ref_sub_v, &band4_ref_sub_v, &band6_ref_sub_v, &band7_ref_sub_v,
+		&sw_albedo_sub_v, &vis_albedo_sub_v, &lut_diff_max, &lut_diff_min };
+	const uword n_inputs = sizeof(inputs) / sizeof(inputs[0]);
+	fvec* outputs[] = { &derived_swdr, &derived_dir, &derived_par, &derived_pardir,
+		&derived_uva, &derived_uvb, &derived_toa_up_flux, &derived_rho };
+	const uword n_outputs = sizeof(outputs) / sizeof(outputs[0]);
+
+	fvec results[n_outputs];
+	for (uword k = 0; k < n_outputs; k++)
+		results[k].set_size(npixels);
+
+	for (uword st = 0; st < npixels; st += chunk)
+	{
+		const uword ed = std::min(st + chunk, npixels) - 1;
+
+		fvec in[n_inputs];
+		for (uword k = 0; k < n_inputs; k++)
+			in[k] = inputs[k]->subvec(st, ed);
+		fvec out[n_outputs];
+
+		const int ok = get_SWDR_chunk(lut, pixel_cell.subvec(st, ed), in[0], in[1], in[2],
+			in[3], in[4], in[5], in[6], in[7],
+			in[8], in[9], in[10], in[11], in[12],
+			in[13], in[14], in[15], in[16],
+			out[0], out[1], out[2], out[3], out[4], out[5],
+			out[6], out[7]);
+		if (ok != 0) return 1;
+
+		for (uword k = 0; k < n_outputs; k++)
+			results[k].subvec(st, ed) = out[k];
+	}
+
+	for (uword k = 0; k < n_outputs; k++)
+		*outputs[k] = std::move(results[k]);
+	return 0;
+}
+
+
+int ahi_swdr::get_SWDR_chunk(const PreparedCellLut& lut, const arma::uvec& pixel_cell, arma::fvec& sza_sub_v, arma::fvec& vza_sub_v, arma::fvec& dem_sub_v,
 	arma::fvec& toa_rad_b1_sub_v, arma::fvec& toa_rad_b3_sub_v, arma::fvec& toa_rad_b4_sub_v, arma::fvec& toa_rad_b6_sub_v, arma::fvec& toa_rad_b7_sub_v,
 	arma::fvec& band1_ref_sub_v, arma::fvec& band3_ref_sub_v, arma::fvec& band4_ref_sub_v, arma::fvec& band6_ref_sub_v, arma::fvec& band7_ref_sub_v, 
 	arma::fvec& sw_albedo_sub_v, arma::fvec& vis_albedo_sub_v,
-	float lut_diff_max, float lut_diff_min,
+	const arma::fvec& lut_diff_max, const arma::fvec& lut_diff_min,
 	arma::fvec& derived_swdr, arma::fvec& derived_dir, arma::fvec& derived_par, arma::fvec& derived_pardir,
 	arma::fvec& derived_uva, arma::fvec& derived_uvb,
-	arma::fvec& derived_toa_up_flux, arma::fvec& derived_rho)
+	arma::fvec& derived_toa_up_flux, arma::fvec& derived_rho) const
 {
 	using namespace std;
 	using namespace arma;
@@ -1122,7 +1505,6 @@ int ahi_swdr::get_SWDR(arma::fmat lut, arma::fvec& sza_sub_v, arma::fvec& vza_su
 	//��lutΪ�Ƕȹ��˺�Ĳ��ұ�
 	//=========================================================================
 
-	fvec COD = lut.col(4);
 	//===============================================					
 	//���Ƕ��и����ӱ�lut���ٰ���ѩָ���и�
 	//��ȡ�ನ����Ϣ
@@ -1144,101 +1526,42 @@ int ahi_swdr::get_SWDR(arma::fmat lut, arma::fvec& sza_sub_v, arma::fvec& vza_su
 
 	//---------------------------------------------
 	//FY-3D,��1��2���κ͵�3,4����ʱ�෴��(�������벻�䣬����ұ����ɣ�
-	const fvec i0_band1 = lut.col(5); //band1
-	const fvec rho_band1 = lut.col(6);
-	const fvec complex_var_band1 = lut.col(7);
 
 	//band2����
 
-	const fvec i0_band3 = lut.col(8); // band3
-	const fvec rho_band3 = lut.col(9);
-	const fvec complex_var_band3 = lut.col(10);
-
-	const fvec i0_band4 = lut.col(11); //band4
-	const fvec rho_band4 = lut.col(12);
-	const fvec complex_var_band4 = lut.col(13);
-
 	//---------------------------------------------
 	//band5����
 
-	const fvec i0_band6 = lut.col(14); //band6
-	const fvec rho_band6 = lut.col(15);
-	const fvec complex_var_band6 = lut.col(16);
-
-	const fvec i0_band7 = lut.col(17); //band7
-	const fvec rho_band7 = lut.col(18);
-	const fvec complex_var_band7 = lut.col(19);
-
 	//================================================================
 	//���ұ�������ɿ�
-	const uword nrows_lut_tile = i0_band1.n_rows;
+	const uword nrows_lut_tile = lut.quantities.n_rows;
 	const uword ncols_lut_tile = toa_rad_b1_sub_v.n_elem;  //toa_rad_b3_sub_v.n_elem;
-	//=====toa_rad(multi bands)========
-	//band1
-	fmat i0_band1_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	i0_band1_tile.each_col() = i0_band1;
-
-	fmat rho_band1_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	rho_band1_tile.each_col() = rho_band1;
-
-	fmat complex_var_band1_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	complex_var_band1_tile.each_col() = complex_var_band1;
-
-	//band3
-	fmat i0_band3_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	i0_band3_tile.each_col() = i0_band3;
-
-	fmat rho_band3_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	rho_band3_tile.each_col() = rho_band3;
-
-	fmat complex_var_band3_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	complex_var_band3_tile.each_col() = complex_var_band3;
-
-	//band4
-	fmat i0_band4_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	i0_band4_tile.each_col() = i0_band4;
-
-	fmat rho_band4_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	rho_band4_tile.each_col() = rho_band4;
-
-	fmat complex_var_band4_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	complex_var_band4_tile.each_col() = complex_var_band4;
-
-	//band6
-	fmat i0_band6_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	i0_band6_tile.each_col() = i0_band6;
-
-	fmat rho_band6_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	rho_band6_tile.each_col() = rho_band6;
-
-	fmat complex_var_band6_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	complex_var_band6_tile.each_col() = complex_var_band6;
-
-	//band7
-	fmat i0_band7_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	i0_band7_tile.each_col() = i0_band7;
-
-	fmat rho_band7_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	rho_band7_tile.each_col() = rho_band7;
-
-	fmat complex_var_band7_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	complex_var_band7_tile.each_col() = complex_var_band7;
 
+	//SZA/VZA nodes of the cell of every pixel; the two nodes of a cell always differ (check_lut),
+	//so every pixel is interpolated between them
+	fvec dw_sza_v(ncols_lut_tile);
+	fvec up_sza_v(ncols_lut_tile);
+	fvec dw_vza_v(ncols_lut_tile);
+	fvec up_vza_v(ncols_lut_tile);
+	for (uword j = 0; j < ncols_lut_tile; j++)
+	{
+		const CellContext& cell = lut.cells[pixel_cell(j)];
+		dw_sza_v(j) = cell.dw_sza;
+		up_sza_v(j) = cell.up_sza;
+		dw_vza_v(j) = cell.dw_vza;
+		up_vza_v(j) = cell.up_vza;
+	}
+	//=====toa_rad(multi bands)========
+	//bands 1, 3, 4, 6 and 7 and the NDSI of the LUT in one pass over the LUT columns of the cell of every pixel;
+	//band 4 only enters the NDSI
 	//-----����ÿ�����ε�toa_radiance---------
-	fmat i0x_band1 = trans(1 / band1_ref_sub_v) - rho_band1_tile.each_row();
-	fmat toa_rad_band1_lut_tile = i0_band1_tile + (1 / i0x_band1) % complex_var_band1_tile;
-
-	fmat i0x_band3 = trans(1 / band3_ref_sub_v) - rho_band3_tile.each_row();
-	fmat toa_rad_band3_lut_tile = i0_band3_tile + (1 / i0x_band3) % complex_var_band3_tile;  //toa_rad_lut_tile
-
-	fmat i0x_band4 = trans(1 / band4_ref_sub_v) - rho_band4_tile.each_row();
-	fmat toa_rad_band4_lut_tile = i0_band4_tile + (1 / i0x_band4) % complex_var_band4_tile;
-
-	fmat i0x_band6 = trans(1 / band6_ref_sub_v) - rho_band6_tile.each_row();
-	fmat toa_rad_band6_lut_tile = i0_band6_tile + (1 / i0x_band6) % complex_var_band6_tile;
-
-	fmat i0x_band7 = trans(1 / band7_ref_sub_v) - rho_band7_tile.each_row();
-	fmat toa_rad_band7_lut_tile = i0_band7_tile + (1 / i0x_band7) % complex_var_band7_tile;
+	fmat toa_rad_band1_lut_tile(nrows_lut_tile, ncols_lut_tile);
+	fmat toa_rad_band3_lut_tile(nrows_lut_tile, ncols_lut_tile);  //toa_rad_lut_tile
+	fmat toa_rad_band6_lut_tile(nrows_lut_tile, ncols_lut_tile);
+	fmat toa_rad_band7_lut_tile(nrows_lut_tile, ncols_lut_tile);
+	fmat toa_rad_ndsi_lut_tile(nrows_lut_tile, ncols_lut_tile);
+	forward_tiles(lut, pixel_cell, band1_ref_sub_v, band3_ref_sub_v, band4_ref_sub_v, band6_ref_sub_v, band7_ref_sub_v,
+		toa_rad_band1_lut_tile, toa_rad_band3_lut_tile, toa_rad_band6_lut_tile, toa_rad_band7_lut_tile, toa_rad_ndsi_lut_tile);
 
 	//======================================================
 
@@ -1258,116 +1581,12 @@ int ahi_swdr::get_SWDR(arma::fmat lut, arma::fvec& sza_sub_v, arma::fvec& vza_su
 		toa_rad_band1_lut_clear_tile, toa_rad_band3_lut_clear_tile, toa_rad_band6_lut_clear_tile, toa_rad_band7_lut_clear_tile,
 		toa_rad_band1_lut_cloudy_tile, toa_rad_band3_lut_cloudy_tile, toa_rad_band7_lut_cloudy_tile);
 
-	//======================================================
-	//���ұ���ѩָ��ֵ(��ѩָ����LUT�ֿ�ֻ��ѭ����ɣ�����3��flag��ÿ��flag�в�ͬ����ʽ
-	fmat toa_rad_ndsi_lut_tile = (toa_rad_band4_lut_tile / 593.84 - toa_rad_band6_lut_tile / 76.53) / (toa_rad_band4_lut_tile / 593.84 + toa_rad_band6_lut_tile / 76.53);//��֤��
+	//the NDSI of the LUT is computed with the radiances by forward_tiles
 
 	//------------������LUT��SWDR & PAR UVA UVB TOA_albedo-------------------------
-	//=======swdr=======
-	const fvec f0 = lut.col(20) + lut.col(21);
-	const fvec f_rho = lut.col(22);
-	const fvec f_complex = lut.col(23);
-	const fvec dir_swdr_lut = lut.col(20);
-
-	//=======par=======
-	const fvec f0_par = lut.col(24) + lut.col(25);
-	const fvec f_rho_par = lut.col(26);
-	const fvec f_complex_par = lut.col(27);
-	const fvec dir_par_lut = lut.col(24);
-
-	//=======uva=======
-	const fvec f0_uva = lut.col(28) + lut.col(29);
-	const fvec f_rho_uva = lut.col(30);
-	const fvec f_complex_uva = lut.col(31);
-	const fvec dir_uva_lut = lut.col(28);
-
-	//=======uvb=======
-	const fvec f0_uvb = lut.col(32) + lut.col(33);
-	const fvec f_rho_uvb = lut.col(34);
-	const fvec f_complex_uvb = lut.col(35);
-	const fvec dir_uvb_lut = lut.col(32);
-
-	//=======toa_albedo(toa_up_flux)=======
-	const fvec f0_albedo = lut.col(36);
-	const fvec f_rho_albedo = lut.col(37);
-	const fvec f_complex_albedo = lut.col(38);
-	const fvec f_toa_dw_flux = lut.col(39);
-
-	//--------------------------------------------
-	//=======swdr========
-	fmat f0_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	f0_tile.each_col() = f0;
-
-	fmat f_rho_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	f_rho_tile.each_col() = f_rho;
-
-	fmat f_complex_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	f_complex_tile.each_col() = f_complex;
-
-	//======par==========
-	fmat f0_par_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	f0_par_tile.each_col() = f0_par;
-
-	fmat f_rho_par_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	f_rho_par_tile.each_col() = f_rho_par;
-
-	fmat f_complex_par_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	f_complex_par_tile.each_col() = f_complex_par;
-
-	//======uva==========
-	fmat f0_uva_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	f0_uva_tile.each_col() = f0_uva;
-
-	fmat f_rho_uva_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	f_rho_uva_tile.each_col() = f_rho_uva;
-
-	fmat f_complex_uva_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	f_complex_uva_tile.each_col() = f_complex_uva;
-
-	//======uvb==========
-	fmat f0_uvb_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	f0_uvb_tile.each_col() = f0_uvb;
-
-	fmat f_rho_uvb_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	f_rho_uvb_tile.each_col() = f_rho_uvb;
-
-	fmat f_complex_uvb_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	f_complex_uvb_tile.each_col() = f_complex_uvb;
-
-	//======toa_albedo==========
-	fmat f0_albedo_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	f0_albedo_tile.each_col() = f0_albedo;
-
-	fmat f_rho_albedo_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	f_rho_albedo_tile.each_col() = f_rho_albedo;
-
-	fmat f_complex_albedo_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	f_complex_albedo_tile.each_col() = f_complex_albedo;
-
-	fmat f_toa_dw_flux_tile(nrows_lut_tile, ncols_lut_tile, arma::fill::zeros);
-	f_toa_dw_flux_tile.each_col() = f_toa_dw_flux;
-
 	//-----------------------------------------
-	//====�ܷ���====
-	fmat f0x = trans(sw_albedo_sub_v) % f_rho_tile.each_row();
-	fmat swdr_tile = f0_tile + f0x / (1 - f0x) % f_complex_tile;
-
-	//====PAR�ܷ���====
-	fmat f0x_par = trans(vis_albedo_sub_v) % f_rho_par_tile.each_row();
-	fmat par_tile = f0_par_tile + f0x_par / (1 - f0x_par) % f_complex_par_tile;
-
-	//====UVA�ܷ���====
-	fmat f0x_uva = trans(vis_albedo_sub_v) % f_rho_uva_tile.each_row();
-	fmat uva_tile = f0_uva_tile + f0x_uva / (1 - f0x_uva) % f_complex_uva_tile;
-
-	//====UVB�ܷ���====
-	fmat f0x_uvb = trans(vis_albedo_sub_v) % f_rho_uvb_tile.each_row();
-	fmat uvb_tile = f0_uvb_tile + f0x_uvb / (1 - f0x_uvb) % f_complex_uvb_tile;
-
-	//====TOA_albedo====
-	fmat f0x_albedo = trans(1 / sw_albedo_sub_v) - f_rho_albedo_tile.each_row();
-	fmat toa_albedo_tile = f0_albedo_tile + (1 / f0x_albedo) % f_complex_albedo_tile;
-	fmat toa_up_flux_tile = toa_albedo_tile % f_toa_dw_flux_tile; //��Ҫȷ���Ƿ���ÿcol���
+	//the SWDR, PAR, UVA, UVB and TOA upward fluxes are computed in interp_dem from the albedos of the pixels,
+	//only at the LUT rows matched to each pixel
 
 	//========================================================================
 	fvec ref_mean_sub_v = (band1_ref_sub_v + band3_ref_sub_v) / 2;
@@ -1385,14 +1604,14 @@ int ahi_swdr::get_SWDR(arma::fmat lut, arma::fvec& sza_sub_v, arma::fvec& vza_su
 	fvec us_uv_rho;
 
 	//-------��ֵus_uv_DEM----------------------------
-	int flag = interp_dem(dem_sub_v, toa_rad_b1_sub_v, toa_rad_b3_sub_v, toa_rad_b6_sub_v, toa_rad_b7_sub_v,
+	int flag = interp_dem(lut, pixel_cell, dem_sub_v, toa_rad_b1_sub_v, toa_rad_b3_sub_v, toa_rad_b6_sub_v, toa_rad_b7_sub_v,
 		toa_rad_band1_lut_tile, toa_rad_band3_lut_tile, toa_rad_band6_lut_tile, toa_rad_band7_lut_tile,
 		toa_rad_band1_lut_clear_tile, toa_rad_band3_lut_clear_tile, toa_rad_band6_lut_clear_tile, toa_rad_band7_lut_clear_tile,
 		toa_rad_band1_lut_cloudy_tile, toa_rad_band3_lut_cloudy_tile, toa_rad_band7_lut_cloudy_tile,
 		toa_rad_ndsi_lut_tile, lut_diff_max, lut_diff_min,
 		idx_us_uv_ud, idx_us_uv_dd,
-		swdr_tile, dir_swdr_lut, par_tile, dir_par_lut, uva_tile, uvb_tile, toa_up_flux_tile,
-		COD, f_rho, ref_mean_sub_v, band1_ref_sub_v, band3_ref_sub_v, band6_ref_sub_v, band7_ref_sub_v, sza_sub_v,
+		sw_albedo_sub_v, vis_albedo_sub_v,
+		ref_mean_sub_v, band1_ref_sub_v, band3_ref_sub_v, band6_ref_sub_v, band7_ref_sub_v, sza_sub_v,
 		us_uv_swdr, us_uv_swdir, us_uv_par, us_uv_pardir, us_uv_uva, us_uv_uvb, us_uv_toa_up_flux, us_uv_rho);
 	if (flag != 0) return 1;
 
@@ -1409,87 +1628,60 @@ int ahi_swdr::get_SWDR(arma::fmat lut, arma::fvec& sza_sub_v, arma::fvec& vza_su
 	fvec up_sza_toa_up_flux = zeros<fvec>(ncols_lut_tile) - 1.0;
 	fvec up_sza_rho = zeros<fvec>(ncols_lut_tile) - 1.0;
 
-	if (m_up_vza == m_dw_vza)
-	{
-		up_sza_swdr = us_uv_swdr;
-		up_sza_swdir = us_uv_swdir;
-		up_sza_par = us_uv_par;
-		up_sza_pardir = us_uv_pardir;
-		up_sza_uva = us_uv_uva;
-		up_sza_uvb = us_uv_uvb;
-		up_sza_toa_up_flux = us_uv_toa_up_flux;
-		up_sza_rho = us_uv_rho;
-	}
-	else
-	{
-		// -------------------------------------------------------
-		// (22) flux at (up_sza, dw_vza)
-
-		fvec us_dv_swdr;
-		fvec us_dv_swdir;
-		fvec us_dv_par;
-		fvec us_dv_pardir;
-		fvec us_dv_uva;
-		fvec us_dv_uva_dir;
-		fvec us_dv_uvb;
-		fvec us_dv_uvb_dir;
-		fvec us_dv_toa_up_flux;
-		fvec us_dv_rho;
-
-		//-------��ֵus_dv_DEM----------------------------
-
-		flag = interp_dem(dem_sub_v, toa_rad_b1_sub_v, toa_rad_b3_sub_v, toa_rad_b6_sub_v, toa_rad_b7_sub_v,
-			toa_rad_band1_lut_tile, toa_rad_band3_lut_tile, toa_rad_band6_lut_tile, toa_rad_band7_lut_tile,
-			toa_rad_band1_lut_clear_tile, toa_rad_band3_lut_clear_tile, toa_rad_band6_lut_clear_tile, toa_rad_band7_lut_clear_tile,
-			toa_rad_band1_lut_cloudy_tile, toa_rad_band3_lut_cloudy_tile, toa_rad_band7_lut_cloudy_tile,
-			toa_rad_ndsi_lut_tile, lut_diff_max, lut_diff_min,
-			idx_us_dv_ud, idx_us_dv_dd,
-			swdr_tile, dir_swdr_lut, par_tile, dir_par_lut, uva_tile, uvb_tile, toa_up_flux_tile,
-			COD, f_rho, ref_mean_sub_v, band1_ref_sub_v, band3_ref_sub_v, band6_ref_sub_v, band7_ref_sub_v, sza_sub_v,
-			us_dv_swdr, us_dv_swdir, us_dv_par, us_dv_pardir, us_dv_uva, us_dv_uvb, us_dv_toa_up_flux, us_dv_rho);
-
-		if (flag != 0) return 1;
-
-		// -------------------------------------------------------
-		// (33) interpolated flux at (up_SZA)
+	// -------------------------------------------------------
+	// (22) flux at (up_sza, dw_vza)
+
+	fvec us_dv_swdr;
+	fvec us_dv_swdir;
+	fvec us_dv_par;
+	fvec us_dv_pardir;
+	fvec us_dv_uva;
+	fvec us_dv_uva_dir;
+	fvec us_dv_uvb;
+	fvec us_dv_uvb_dir;
+	fvec us_dv_toa_up_flux;
+	fvec us_dv_rho;
+
+	//-------��ֵus_dv_DEM----------------------------
+
+	flag = interp_dem(lut, pixel_cell, dem_sub_v, toa_rad_b1_sub_v, toa_rad_b3_sub_v, toa_rad_b6_sub_v, toa_rad_b7_sub_v,
+		toa_rad_band1_lut_tile, toa_rad_band3_lut_tile, toa_rad_band6_lut_tile, toa_rad_band7_lut_tile,
+		toa_rad_band1_lut_clear_tile, toa_rad_band3_lut_clear_tile, toa_rad_band6_lut_clear_tile, toa_rad_band7_lut_clear_tile,
+		toa_rad_band1_lut_cloudy_tile, toa_rad_band3_lut_cloudy_tile, toa_rad_band7_lut_cloudy_tile,
+		toa_rad_ndsi_lut_tile, lut_diff_max, lut_diff_min,
+		idx_us_dv_ud, idx_us_dv_dd,
+		sw_albedo_sub_v, vis_albedo_sub_v,
+		ref_mean_sub_v, band1_ref_sub_v, band3_ref_sub_v, band6_ref_sub_v, band7_ref_sub_v, sza_sub_v,
+		us_dv_swdr, us_dv_swdir, us_dv_par, us_dv_pardir, us_dv_uva, us_dv_uvb, us_dv_toa_up_flux, us_dv_rho);
 
-		fmat slope = (us_uv_swdr - us_dv_swdr) / (m_up_vza - m_dw_vza);
-		up_sza_swdr = us_dv_swdr + slope % (vza_sub_v - m_dw_vza);
+	if (flag != 0) return 1;
 
-		slope = (us_uv_swdir - us_dv_swdir) / (m_up_vza - m_dw_vza);
-		up_sza_swdir = us_dv_swdir + slope % (vza_sub_v - m_dw_vza);
+	// -------------------------------------------------------
+	// (33) interpolated flux at (up_SZA)
 
-		slope = (us_uv_par - us_dv_par) / (m_up_vza - m_dw_vza);
-		up_sza_par = us_dv_par + slope % (vza_sub_v - m_dw_vza);
+	fmat slope = (us_uv_swdr - us_dv_swdr) / (up_vza_v - dw_vza_v);
+	up_sza_swdr = us_dv_swdr + slope % (vza_sub_v - dw_vza_v);
 
-		slope = (us_uv_pardir - us_dv_pardir) / (m_up_vza - m_dw_vza);
-		up_sza_pardir = us_dv_pardir + slope % (vza_sub_v - m_dw_vza);
+	slope = (us_uv_swdir - us_dv_swdir) / (up_vza_v - dw_vza_v);
+	up_sza_swdir = us_dv_swdir + slope % (vza_sub_v - dw_vza_v);
 
-		slope = (us_uv_uva - us_dv_uva) / (m_up_vza - m_dw_vza);
-		up_sza_uva = us_dv_uva + slope % (vza_sub_v - m_dw_vza);
+	slope = (us_uv_par - us_dv_par) / (up_vza_v - dw_vza_v);
+	up_sza_par = us_dv_par + slope % (vza_sub_v - dw_vza_v);
 
-		slope = (us_uv_uvb - us_dv_uvb) / (m_up_vza - m_dw_vza);
-		up_sza_uvb = us_dv_uvb + slope % (vza_sub_v - m_dw_vza);
+	slope = (us_uv_pardir - us_dv_pardir) / (up_vza_v - dw_vza_v);
+	up_sza_pardir = us_dv_pardir + slope % (vza_sub_v - dw_vza_v);
 
-		slope = (us_uv_toa_up_flux - us_dv_toa_up_flux) / (m_up_vza - m_dw_vza);
-		up_sza_toa_up_flux = us_dv_toa_up_flux + slope % (vza_sub_v - m_dw_vza);
+	slope = (us_uv_uva - us_dv_uva) / (up_vza_v - dw_vza_v);
+	up_sza_uva = us_dv_uva + slope % (vza_sub_v - dw_vza_v);
 
-		slope = (us_uv_rho - us_dv_rho) / (m_up_vza - m_dw_vza);
-		up_sza_rho = us_dv_rho + slope % (vza_sub_v - m_dw_vza);
+	slope = (us_uv_uvb - us_dv_uvb) / (up_vza_v - dw_vza_v);
+	up_sza_uvb = us_dv_uvb + slope % (vza_sub_v - dw_vza_v);
 
-	}
+	slope = (us_uv_toa_up_flux - us_dv_toa_up_flux) / (up_vza_v - dw_vza_v);
+	up_sza_toa_up_flux = us_dv_toa_up_flux + slope % (vza_sub_v - dw_vza_v);
 
-	if (m_up_sza == m_dw_sza)
-	{
-		derived_swdr = up_sza_swdr;
-		derived_dir = up_sza_swdir;
-		derived_par = up_sza_par;
-		derived_pardir = up_sza_pardir;
-		derived_uva = up_sza_uva;
-		derived_uvb = up_sza_uvb;
-		derived_toa_up_flux = up_sza_toa_up_flux;
-		derived_rho = up_sza_rho;
-	}
+	slope = (us_uv_rho - us_dv_rho) / (up_vza_v - dw_vza_v);
+	up_sza_rho = us_dv_rho + slope % (vza_sub_v - dw_vza_v);
 
 	// -------------------------------------------------------
 	// Next interpolated for flux at(dw_SZA) solar(2nd half) 
@@ -1506,14 +1698,14 @@ int ahi_swdr::get_SWDR(arma::fmat lut, arma::fvec& sza_sub_v, arma::fvec& vza_su
 
 	//-------��ֵds_uv_DEM----------------------------
 
-	flag = interp_dem(dem_sub_v, toa_rad_b1_sub_v, toa_rad_b3_sub_v, toa_rad_b6_sub_v, toa_rad_b7_sub_v,
+	flag = interp_dem(lut, pixel_cell, dem_sub_v, toa_rad_b1_sub_v, toa_rad_b3_sub_v, toa_rad_b6_sub_v, toa_rad_b7_sub_v,
 		toa_rad_band1_lut_tile, toa_rad_band3_lut_tile, toa_rad_band6_lut_tile, toa_rad_band7_lut_tile,
 		toa_rad_band1_lut_clear_tile, toa_rad_band3_lut_clear_tile, toa_rad_band6_lut_clear_tile, toa_rad_band7_lut_clear_tile,
 		toa_rad_band1_lut_cloudy_tile, toa_rad_band3_lut_cloudy_tile, toa_rad_band7_lut_cloudy_tile,
 		toa_rad_ndsi_lut_tile, lut_diff_max, lut_diff_min,
 		idx_ds_uv_ud, idx_ds_uv_dd,
-		swdr_tile, dir_swdr_lut, par_tile, dir_par_lut, uva_tile, uvb_tile, toa_up_flux_tile,
-		COD, f_rho, ref_mean_sub_v, band1_ref_sub_v, band3_ref_sub_v, band6_ref_sub_v, band7_ref_sub_v, sza_sub_v,
+		sw_albedo_sub_v, vis_albedo_sub_v,
+		ref_mean_sub_v, band1_ref_sub_v, band3_ref_sub_v, band6_ref_sub_v, band7_ref_sub_v, sza_sub_v,
 		ds_uv_swdr, ds_uv_swdir, ds_uv_par, ds_uv_pardir, ds_uv_uva, ds_uv_uvb, ds_uv_toa_up_flux, ds_uv_rho);
 
 	if (flag != 0) return 1;
@@ -1529,97 +1721,83 @@ int ahi_swdr::get_SWDR(arma::fmat lut, arma::fvec& sza_sub_v, arma::fvec& vza_su
 	fvec dw_sza_toa_up_flux = zeros<fvec>(ncols_lut_tile) - 1.0;
 	fvec dw_sza_rho = zeros<fvec>(ncols_lut_tile) - 1.0;
 
-	if (m_up_vza == m_dw_vza)
-	{
-		dw_sza_swdr = ds_uv_swdr;
-		dw_sza_swdir = ds_uv_swdir;
-		dw_sza_par = ds_uv_par;
-		dw_sza_pardir = ds_uv_pardir;
-		dw_sza_uva = ds_uv_uva;
-		dw_sza_uvb = ds_uv_uvb;
-		dw_sza_toa_up_flux = ds_uv_toa_up_flux;
-		dw_sza_rho = ds_uv_rho;
-	}
-	else
-	{
-		// (55) flux at (dw_sza, dw_vza)
-		fvec ds_dv_swdr;
-		fvec ds_dv_swdir;
-		fvec ds_dv_par;
-		fvec ds_dv_pardir;
-		fvec ds_dv_uva;
-		fvec ds_dv_uvb;
-		fvec ds_dv_toa_up_flux;
-		fvec ds_dv_rho;
+	// (55) flux at (dw_sza, dw_vza)
+	fvec ds_dv_swdr;
+	fvec ds_dv_swdir;
+	fvec ds_dv_par;
+	fvec ds_dv_pardir;
+	fvec ds_dv_uva;
+	fvec ds_dv_uvb;
+	fvec ds_dv_toa_up_flux;
+	fvec ds_dv_rho;
 
-		//-------��ֵds_dv_DEM----------------------------
+	//-------��ֵds_dv_DEM----------------------------
 
-		flag = interp_dem(dem_sub_v, toa_rad_b1_sub_v, toa_rad_b3_sub_v, toa_rad_b6_sub_v, toa_rad_b7_sub_v,
-			toa_rad_band1_lut_tile, toa_rad_band3_lut_tile, toa_rad_band6_lut_tile, toa_rad_band7_lut_tile,
-			toa_rad_band1_lut_clear_tile, toa_rad_band3_lut_clear_tile, toa_rad_band6_lut_clear_tile, toa_rad_band7_lut_clear_tile,
-			toa_rad_band1_lut_cloudy_tile, toa_rad_band3_lut_cloudy_tile, toa_rad_band7_lut_cloudy_tile,
-			toa_rad_ndsi_lut_tile, lut_diff_max, lut_diff_min,
-			idx_ds_dv_ud, idx_ds_dv_dd,
-			swdr_tile, dir_swdr_lut, par_tile, dir_par_lut, uva_tile, uvb_tile, toa_up_flux_tile,
-			COD, f_rho, ref_mean_sub_v, band1_ref_sub_v, band3_ref_sub_v, band6_ref_sub_v, band7_ref_sub_v, sza_sub_v,
-			ds_dv_swdr, ds_dv_swdir, ds_dv_par, ds_dv_pardir, ds_dv_uva, ds_dv_uvb, ds_dv_toa_up_flux, ds_dv_rho);
+	flag = interp_dem(lut, pixel_cell, dem_sub_v, toa_rad_b1_sub_v, toa_rad_b3_sub_v, toa_rad_b6_sub_v, toa_rad_b7_sub_v,
+		toa_rad_band1_lut_tile, toa_rad_band3_lut_tile, toa_rad_band6_lut_tile, toa_rad_band7_lut_tile,
+		toa_rad_band1_lut_clear_tile, toa_rad_band3_lut_clear_tile, toa_rad_band6_lut_clear_tile, toa_rad_band7_lut_clear_tile,
+		toa_rad_band1_lut_cloudy_tile, toa_rad_band3_lut_cloudy_tile, toa_rad_band7_lut_cloudy_tile,
+		toa_rad_ndsi_lut_tile, lut_diff_max, lut_diff_min,
+		idx_ds_dv_ud, idx_ds_dv_dd,
+		sw_albedo_sub_v, vis_albedo_sub_v,
+		ref_mean_sub_v, band1_ref_sub_v, band3_ref_sub_v, band6_ref_sub_v, band7_ref_sub_v, sza_sub_v,
+		ds_dv_swdr, ds_dv_swdir, ds_dv_par, ds_dv_pardir, ds_dv_uva, ds_dv_uvb, ds_dv_toa_up_flux, ds_dv_rho);
 
-		if (flag != 0) return 1;
-		//------------------------------------------------------
+	if (flag != 0) return 1;
+	//------------------------------------------------------
 
-		// (66) interpolated flux at (dw_SZA)
-		fmat slope = (ds_uv_swdr - ds_dv_swdr) / (m_up_vza - m_dw_vza);
-		dw_sza_swdr = ds_dv_swdr + slope % (vza_sub_v - m_dw_vza);
+	// (66) interpolated flux at (dw_SZA)
+	slope = (ds_uv_swdr - ds_dv_swdr) / (up_vza_v - dw_vza_v);
+	dw_sza_swdr = ds_dv_swdr + slope % (vza_sub_v - dw_vza_v);
 
-		slope = (ds_uv_swdir - ds_dv_swdir) / (m_up_vza - m_dw_vza);
-		dw_sza_swdir = ds_dv_swdir + slope % (vza_sub_v - m_dw_vza);
+	slope = (ds_uv_swdir - ds_dv_swdir) / (up_vza_v - dw_vza_v);
+	dw_sza_swdir = ds_dv_swdir + slope % (vza_sub_v - dw_vza_v);
 
-		slope = (ds_uv_par - ds_dv_par) / (m_up_vza - m_dw_vza);
-		dw_sza_par = ds_dv_par + slope % (vza_sub_v - m_dw_vza);
+	slope = (ds_uv_par - ds_dv_par) / (up_vza_v - dw_vza_v);
+	dw_sza_par = ds_dv_par + slope % (vza_sub_v - dw_vza_v);
 
-		slope = (ds_uv_pardir - ds_dv_pardir) / (m_up_vza - m_dw_vza);
-		dw_sza_pardir = ds_dv_pardir + slope % (vza_sub_v - m_dw_vza);
+	slope = (ds_uv_pardir - ds_dv_pardir) / (up_vza_v - dw_vza_v);
+	dw_sza_pardir = ds_dv_pardir + slope % (vza_sub_v - dw_vza_v);
 
-		slope = (ds_uv_uva - ds_dv_uva) / (m_up_vza - m_dw_vza);
-		dw_sza_uva = ds_dv_uva + slope % (vza_sub_v - m_dw_vza);
+	slope = (ds_uv_uva - ds_dv_uva) / (up_vza_v - dw_vza_v);
+	dw_sza_uva = ds_dv_uva + slope % (vza_sub_v - dw_vza_v);
 
-		slope = (ds_uv_uvb - ds_dv_uvb) / (m_up_vza - m_dw_vza);
-		dw_sza_uvb = ds_dv_uvb + slope % (vza_sub_v - m_dw_vza);
+	slope = (ds_uv_uvb - ds_dv_uvb) / (up_vza_v - dw_vza_v);
+	dw_sza_uvb = ds_dv_uvb + slope % (vza_sub_v - dw_vza_v);
 
-		slope = (ds_uv_toa_up_flux - ds_dv_toa_up_flux) / (m_up_vza - m_dw_vza);
-		dw_sza_toa_up_flux = ds_dv_toa_up_flux + slope % (vza_sub_v - m_dw_vza);
+	slope = (ds_uv_toa_up_flux - ds_dv_toa_up_flux) / (up_vza_v - dw_vza_v);
+	dw_sza_toa_up_flux = ds_dv_toa_up_flux + slope % (vza_sub_v - dw_vza_v);
 
-		slope = (ds_uv_rho - ds_dv_rho) / (m_up_vza - m_dw_vza);
-		dw_sza_rho = ds_dv_rho + slope % (vza_sub_v - m_dw_vza);
+	slope = (ds_uv_rho - ds_dv_rho) / (up_vza_v - dw_vza_v);
+	dw_sza_rho = ds_dv_rho + slope % (vza_sub_v - dw_vza_v);
 
-	}
 
 	// -------------------------------------------------------
 	// (77) Final interpolated flux at (SZA)
 
-	fmat slope = (up_sza_swdr - dw_sza_swdr) / (m_up_sza - m_dw_sza);
-	fvec itp_swdr = dw_sza_swdr + slope % (sza_sub_v - m_dw_sza);
+	slope = (up_sza_swdr - dw_sza_swdr) / (up_sza_v - dw_sza_v);
+	fvec itp_swdr = dw_sza_swdr + slope % (sza_sub_v - dw_sza_v);
 
-	slope = (up_sza_swdir - dw_sza_swdir) / (m_up_sza - m_dw_sza);
-	fvec itp_swdir = dw_sza_swdir + slope % (sza_sub_v - m_dw_sza);
+	slope = (up_sza_swdir - dw_sza_swdir) / (up_sza_v - dw_sza_v);
+	fvec itp_swdir = dw_sza_swdir + slope % (sza_sub_v - dw_sza_v);
 
-	slope = (up_sza_par - dw_sza_par) / (m_up_sza - m_dw_sza);
-	fvec itp_par = dw_sza_par + slope % (sza_sub_v - m_dw_sza);
+	slope = (up_sza_par - dw_sza_par) / (up_sza_v - dw_sza_v);
+	fvec itp_par = dw_sza_par + slope % (sza_sub_v - dw_sza_v);
 
-	slope = (up_sza_pardir - dw_sza_pardir) / (m_up_sza - m_dw_sza);
-	fvec itp_pardir = dw_sza_pardir + slope % (sza_sub_v - m_dw_sza);
+	slope = (up_sza_pardir - dw_sza_pardir) / (up_sza_v - dw_sza_v);
+	fvec itp_pardir = dw_sza_pardir + slope % (sza_sub_v - dw_sza_v);
 
-	slope = (up_sza_uva - dw_sza_uva) / (m_up_sza - m_dw_sza);
-	fvec itp_uva = dw_sza_uva + slope % (sza_sub_v - m_dw_sza);
+	slope = (up_sza_uva - dw_sza_uva) / (up_sza_v - dw_sza_v);
+	fvec itp_uva = dw_sza_uva + slope % (sza_sub_v - dw_sza_v);
 
-	slope = (up_sza_uvb - dw_sza_uvb) / (m_up_sza - m_dw_sza);
-	fvec itp_uvb = dw_sza_uvb + slope % (sza_sub_v - m_dw_sza);
+	slope = (up_sza_uvb - dw_sza_uvb) / (up_sza_v - dw_sza_v);
+	fvec itp_uvb = dw_sza_uvb + slope % (sza_sub_v - dw_sza_v);
 
-	slope = (up_sza_toa_up_flux - dw_sza_toa_up_flux) / (m_up_sza - m_dw_sza);
-	fvec itp_toa_up_flux = dw_sza_toa_up_flux + slope % (sza_sub_v - m_dw_sza);
+	slope = (up_sza_toa_up_flux - dw_sza_toa_up_flux) / (up_sza_v - dw_sza_v);
+	fvec itp_toa_up_flux = dw_sza_toa_up_flux + slope % (sza_sub_v - dw_sza_v);
 
-	slope = (up_sza_rho - dw_sza_rho) / (m_up_sza - m_dw_sza);
-	fvec itp_rho = dw_sza_rho + slope % (sza_sub_v - m_dw_sza);
+	slope = (up_sza_rho - dw_sza_rho) / (up_sza_v - dw_sza_v);
+	fvec itp_rho = dw_sza_rho + slope % (sza_sub_v - dw_sza_v);
 
 	// ----------------------------------------------------
 	//���ռ�����
@@ -1637,137 +1815,43 @@ int ahi_swdr::get_SWDR(arma::fmat lut, arma::fvec& sza_sub_v, arma::fvec& vza_su
 }
 
 
-int ahi_swdr::read_lut(const std::string& lut_file, const arma::uword& lut_cols)
+int ahi_swdr::check_lut() const
 {
 	using namespace std;
-	using namespace arma;
-
-	namespace fs = std::filesystem;
-
-	const size_t ncols = lut_cols;  //LUT������
 
-	if (lut_file.length() == 0)
+	//the DEM nodes are the innermost blocks of the LUT, the tiles interpolate between two of them
+	if (m_lut->n_cols() != LUT_Q_NUM || idx_filter_dem != m_lut->block_rows()
+		|| m_dem_list.n_elem < 2 || m_sza_list.n_elem < 2 || m_vza_list.n_elem < 2)
 	{
-		cout << "Please specify LUT file\n";
+		cout << "[Error] the LUT file cannot be used by the retrieval:\n";
+		m_lut->print();
 		return 1;
 	}
 
-	const fs::path mypath{ lut_file };
-	bool flag = fs::exists(mypath);
-	if (!flag)
+	//a cell spans two different SZA and VZA nodes, get_SWDR always interpolates between them
+	for (arma::uword i = 0; i + 1 < m_sza_list.n_elem; i++)
 	{
-		cout << "[Error] cannot find the LUT file: " << lut_file << endl;
-		return 1;
-	}
-
-	fs::path lut_path = mypath.parent_path();
-	fs::path lut_stem = mypath.stem();
-	lut_stem = lut_stem.u8string() + ".bin";
-	fs::path lut_bin_file = lut_path / lut_stem;
-
-	if (fs::exists(lut_bin_file))
-	{
-		cout << "Load LUT directly from " << lut_bin_file.u8string() << endl;
-		m_lut.load(lut_bin_file.u8string());
-		return 0;
-	}
-
-	ifstream fid{ lut_file };
-	if (fid.is_open() != 1)
-	{
-		cout << "Cannot open input file: " << lut_file << endl;
-		return 1;
+		if (m_sza_list(i) >= m_sza_list(i + 1))
+		{
+			cout << "[Error] the SZA nodes of the LUT are not increasing degrees\n";
+			return 1;
+		}
 	}
-
-	string tmp;
-	vector<string> data;
-	while (!fid.eof())
+	for (arma::uword j = 0; j + 1 < m_vza_list.n_elem; j++)
 	{
-		getline(fid, tmp);
-		data.push_back(tmp);
+		if (m_vza_list(j) >= m_vza_list(j + 1))
+		{
+			cout << "[Error] the VZA nodes of the LUT are not increasing degrees\n";
+			return 1;
+		}
 	}
-	fid.close();
-
-	//===============================================================
-	//// calculate ncols,�����Զ�������LUT���У����Ǹ���ֵ����
-	//string line_head = data[0];
-	//vector<string> pack_head;
-	//boost::split(pack_head, line_head, boost::is_any_of(" "), boost::token_compress_on);
-
-	//// Remove the invalid element
-	//vector<string> pack_head2;
-	//for (auto& item : pack_head)
-	//{
-	//	boost::trim(item);
-	//	if (item.length() > 0)
-	//		pack_head2.emplace_back(item);
-	//}
-	//const size_t ncols = pack_head2.size();
-	//===============================================================
-
-	// Remove the headers
-	data.erase(data.begin());
-
-	// vector to arma::fmat
-	const size_t nrows = data.size();
-	m_lut = arma::zeros<arma::fmat>(nrows, ncols);
-
-    try {
-        for (size_t ir = 0; ir < nrows; ir++)
-        {
-            const string line = data[ir];
-
-            vector<string> pack;
-            boost::split(pack, line, boost::is_any_of(" "), boost::token_compress_on);
-
-            // Remove the invalid element
-            vector<string> pack2;
-            for (auto& item : pack)
-            {
-                boost::trim(item);
-                if (item.length() > 0)
-                    pack2.emplace_back(item);
-            }
-
-            if (pack2.size() != ncols)
-            {
-                cout << "The LUT data is wrong. Only " << pack2.size() << " elements.\n";
-                for (const auto& ele : pack2)
-                    cout << ele << " ";
-                cout << endl;
-                return 1;
-            }
-
-            for (size_t ic = 0; ic < pack2.size(); ic++)
-            {
-                tmp = pack2[ic];
-                try {
-                    double val = std::stod(tmp);
-                    m_lut(ir, ic) = static_cast<float>(val);
-                } catch (const std::invalid_argument& e) {
-                    cerr << "Invalid float format: " << tmp << " in line: " << line << endl;
-                    return 1;
-                } catch (const std::out_of_range& e) {
-                    cerr << "Float value out of range: " << tmp << " in line: " << line << endl;
-                    return 1;
-                }
-            }
-        }
-    } catch (const std::exception& e) {
-        cerr << "Exception occurred: " << e.what() << endl;
-        return 1;
-    }
-
-	if (!m_lut.save(lut_bin_file.u8string()))
-		return 1;
-	cout << "Save the LUT file to the binary file: " << lut_bin_file << endl;
 
 	return 0;
 }
 
 
 //������sza, Ҳ������vza
-int ahi_swdr::filter_sza(float sza_min, float sza_max, arma::uword& up_sza_idx, arma::uword& dw_sza_idx, const arma::fvec& angle_list, arma::uword m_angle_min, arma::uword m_angle_max)
+int ahi_swdr::filter_sza(float sza_min, float sza_max, arma::uword& up_sza_idx, arma::uword& dw_sza_idx, const arma::fvec& angle_list, arma::uword m_angle_min, arma::uword m_angle_max) const
 {
 	using namespace std;
 	using namespace arma;
@@ -1824,15 +1908,163 @@ int ahi_swdr::filter_sza(float sza_min, float sza_max, arma::uword& up_sza_idx,
 }
 
 
-int ahi_swdr::interp_dem(arma::fvec& dem_sub_v, arma::fvec& toa_rad_b1_sub_v, arma::fvec& toa_rad_b3_sub_v, arma::fvec& toa_rad_b6_sub_v, arma::fvec& toa_rad_b7_sub_v,
-	arma::fmat toa_rad_band1_lut_tile, arma::fmat toa_rad_band3_lut_tile, arma::fmat toa_rad_band6_lut_tile, arma::fmat toa_rad_band7_lut_tile,
-	arma::fmat toa_rad_band1_lut_clear_tile, arma::fmat toa_rad_band3_lut_clear_tile, arma::fmat toa_rad_band6_lut_clear_tile, arma::fmat toa_rad_band7_lut_clear_tile,
-	arma::fmat toa_rad_band1_lut_cloudy_tile, arma::fmat& toa_rad_band3_lut_cloudy_tile, arma::fmat toa_rad_band7_lut_cloudy_tile,
-	arma::fmat toa_rad_ndsi_lut_tile, float lut_diff_max, float lut_diff_min,
+int ahi_swdr::prepare_cell_lut(const PixelBins& bins, const arma::uvec& cells, PreparedCellLut& lut) const
+{
+	using namespace arma;
+
+	//the copy of the NUMA node this task runs on
+	const LutStore& lut_store = local_lut();
+
+	const uword nrows = 8 * idx_filter_dem;
+	lut.cells.resize(cells.n_elem);
+	lut.quantities.set_size(nrows, LUT_Q_NUM, cells.n_elem);
+	for (uword c = 0; c < cells.n_elem; c++)
+	{
+		const uword key = bins.cells(cells(c));
+		const uword n = key % bins.n_dem;
+		const uword m = (key / bins.n_dem) % bins.n_los;
+		const uword j = (key / (bins.n_dem * bins.n_los)) % bins.n_vza;
+		const uword i = key / (bins.n_dem * bins.n_los * bins.n_vza);
+
+		const uword dw_sza_idx = i;
+		const uword up_sza_idx = i + 1;
+		const uword dw_vza_idx = j;
+		const uword up_vza_idx = j + 1;
+		const uword los_idx = m; //LOS, the nearest node
+		const uword dw_dem_idx = n;
+		const uword up_dem_idx = n + 1;
+
+		//node values of the cell, passed on to the retrieval of its pixels
+		lut.cells[c] = CellContext{ m_sza_list(dw_sza_idx), m_sza_list(up_sza_idx),
+			m_vza_list(dw_vza_idx), m_vza_list(up_vza_idx), m_los_list_ft(los_idx),
+			m_dem_list(dw_dem_idx), m_dem_list(up_dem_idx) };
+
+		//(1)dw_SZA_dw_VZA, (2)dw_SZA_up_VZA, (3)up_SZA_dw_VZA, (4)up_SZA_up_VZA, then LOS and dw_DEM
+		const uword st = los_idx * idx_filter_los + dw_dem_idx * idx_filter_dem;
+		const uword st_ds_dv_ld = dw_sza_idx * idx_filter_sza + dw_vza_idx * idx_filter_vza + st;
+		const uword st_ds_uv_ld = dw_sza_idx * idx_filter_sza + up_vza_idx * idx_filter_vza + st;
+		const uword st_us_dv_ld = up_sza_idx * idx_filter_sza + dw_vza_idx * idx_filter_vza + st;
+		const uword st_us_uv_ld = up_sza_idx * idx_filter_sza + up_vza_idx * idx_filter_vza + st;
+
+		//the dw/up DEM blocks of the 4 SZA/VZA corners, decoded from the LUT store straight into
+		//the slice of the cell, block ib at rows ib * idx_filter_dem
+		const uvec cell_rows = { st_ds_dv_ld, st_ds_dv_ld + idx_filter_dem, st_ds_uv_ld, st_ds_uv_ld + idx_filter_dem,
+			st_us_dv_ld, st_us_dv_ld + idx_filter_dem, st_us_uv_ld, st_us_uv_ld + idx_filter_dem };
+		for (uword ib = 0; ib < cell_rows.n_elem; ib++)
+		{
+			if (lut_store.copy_rows(cell_rows(ib), idx_filter_dem, lut.quantities.slice(c), ib * idx_filter_dem) != 0) return 1;
+		}
+	}
+	return 0;
+}
+
+
+void ahi_swdr::bin_pixels(const arma::fvec& sza_v, const arma::fvec& vza_v, const arma::fvec& los_v, const arma::fvec& dem_v,
+	const arma::fvec& toa_rad_b6_v, const arma::fvec& toa_rad_b7_v,
+	arma::uword sza_st, arma::uword sza_ed, arma::uword vza_st, arma::uword vza_ed, const ImageCells* retrieved,
+	PixelBins& bins) const
+{
+	using namespace arma;
+
+	const fvec sza_edges = conv_to<fvec>::from(m_sza_list);
+	const fvec vza_edges = conv_to<fvec>::from(m_vza_list);
+
+	//LOS, the nearest node: the cells are split half way between two nodes
+	const uword los_num = m_los_list_ft.n_elem;
+	fvec los_edges(los_num + 1);
+	los_edges(0) = m_los_list_ft(0);
+	los_edges(los_num) = m_los_list_ft(los_num - 1);
+	for (uword m = 1; m < los_num; m++)
+		los_edges(m) = (m_los_list_ft(m - 1) + m_los_list_ft(m)) / 2;
+
+	bins.n_sza = m_sza_list.n_elem - 1;
+	bins.n_vza = m_vza_list.n_elem - 1;
+	bins.n_los = los_num;
+	bins.n_dem = m_dem_list.n_elem - 1;
+	const uword n_cells = bins.n_sza * bins.n_vza * bins.n_los * bins.n_dem;
+
+	bins.sza_vza_count.zeros(bins.n_sza * bins.n_vza);
+	bins.los_count.zeros(bins.n_sza * bins.n_vza * bins.n_los);
+	bins.cell_count.zeros(n_cells);
+
+	//(1) cell key of every pixel, n_cells for none, and the pixels per cell
+	const uword npixels = sza_v.n_elem;
+	uvec keys(npixels);
+	uvec count(n_cells + 1, fill::zeros);
+	for (uword ip = 0; ip < npixels; ip++)
+	{
+		keys(ip) = n_cells;
+
+		uword is[2], iv[2], il[2], id[2];
+		const uword ns = find_cells(sza_v(ip), sza_edges, sza_st, sza_ed, is);
+		const uword nv = find_cells(vza_v(ip), vza_edges, vza_st, vza_ed, iv);
+		const uword nl = find_cells(los_v(ip), los_edges, 0, bins.n_los, il);
+		const uword nd = find_cells(dem_v(ip), m_dem_list, 0, bins.n_dem, id);
+		const bool positive = toa_rad_b6_v(ip) > 0 && toa_rad_b7_v(ip) > 0;
+
+		//a pixel on a node is counted in the cells on both sides, and binned into the last of its
+		//cells (the largest key) that is retrieved, which wrote it last in a loop over the cells
+		for (uword a = 0; a < ns; a++)
+		{
+			for (uword b = 0; b < nv; b++)
+			{
+				const uword sv = is[a] * bins.n_vza + iv[b];
+				bins.sza_vza_count(sv)++;
+
+				for (uword c = 0; c < nl; c++)
+				{
+					const uword svl = sv * bins.n_los + il[c];
+					bins.los_count(svl)++;
+					if (!positive) continue;
+
+					for (uword d = 0; d < nd; d++)
+					{
+						const uword key = svl * bins.n_dem + id[d];
+						bins.cell_count(key)++;
+						if (retrieved != nullptr && !cell_retrieved(*retrieved, key)) continue;
+						if (keys(ip) == n_cells || key > keys(ip)) keys(ip) = key;
+					}
+				}
+			}
+		}
+		if (keys(ip) != n_cells) count(keys(ip))++;
+	}
+
+	//(2) the occupied cells and their first pixel
+	const uword n_occupied = accu(count.head(n_cells) > 0);
+	bins.cells.set_size(n_occupied);
+	bins.cell_start.set_size(n_occupied + 1);
+	uvec next(n_cells);
+	uword pos = 0;
+	uword ic = 0;
+	for (uword key = 0; key < n_cells; key++)
+	{
+		next(key) = pos;
+		if (count(key) == 0) continue;
+		bins.cells(ic) = key;
+		bins.cell_start(ic) = pos;
+		pos += count(key);
+		ic++;
+	}
+	bins.cell_start(n_occupied) = pos;
+
+	//(3) pixel indices grouped by cell, in image order inside a cell
+	bins.pixels.set_size(pos);
+	for (uword ip = 0; ip < npixels; ip++)
+	{
+		if (keys(ip) == n_cells) continue;
+		bins.pixels(next(keys(ip))++) = ip;
+	}
+}
+
+
+int ahi_swdr::interp_dem(const PreparedCellLut& lut, const arma::uvec& pixel_cell, arma::fvec& dem_sub_v, arma::fvec& toa_rad_b1_sub_v, arma::fvec& toa_rad_b3_sub_v, arma::fvec& toa_rad_b6_sub_v, arma::fvec& toa_rad_b7_sub_v,
+	const arma::fmat& toa_rad_band1_lut_tile, const arma::fmat& toa_rad_band3_lut_tile, const arma::fmat& toa_rad_band6_lut_tile, const arma::fmat& toa_rad_band7_lut_tile,
+	const arma::fmat& toa_rad_band1_lut_clear_tile, const arma::fmat& toa_rad_band3_lut_clear_tile, const arma::fmat& toa_rad_band6_lut_clear_tile, const arma::fmat& toa_rad_band7_lut_clear_tile,
+	const arma::fmat& toa_rad_band1_lut_cloudy_tile, const arma::fmat& toa_rad_band3_lut_cloudy_tile, const arma::fmat& toa_rad_band7_lut_cloudy_tile,
+	const arma::fmat& toa_rad_ndsi_lut_tile, const arma::fvec& lut_diff_max, const arma::fvec& lut_diff_min,
 	arma::uword& idx_up_dem, arma::uword& idx_dw_dem,
-	arma::fmat swdr_lut_tile, arma::fvec swdr_dir_lut_tile, arma::fmat par_lut_tile, arma::fvec par_dir_lut_tile, arma::fmat uva_lut_tile,
-	arma::fmat uvb_lut_tile, arma::fmat toa_up_flux_lut_tile,
-	arma::fvec& COD, const arma::fvec& f_rho, arma::fvec& ref_mean_sub_v, arma::fvec& ref_band1_sub_v, arma::fvec& ref_band3_sub_v, arma::fvec& ref_band6_sub_v, arma::fvec& ref_band7_sub_v, arma::fvec& sza_sub_v,
+	const arma::fvec& sw_albedo_sub_v, const arma::fvec& vis_albedo_sub_v, arma::fvec& ref_mean_sub_v, arma::fvec& ref_band1_sub_v, arma::fvec& ref_band3_sub_v, arma::fvec& ref_band6_sub_v, arma::fvec& ref_band7_sub_v, arma::fvec& sza_sub_v,
 	arma::fvec& itp_swdr, arma::fvec& itp_swdir, arma::fvec& itp_par, arma::fvec& itp_pardir,
 	arma::fvec& itp_uva, arma::fvec& itp_uvb, arma::fvec& itp_toa_up_flux, arma::fvec& itp_rho) const
 {
@@ -1845,26 +2077,7 @@ int ahi_swdr::interp_dem(arma::fvec& dem_sub_v, arma::fvec& toa_rad_b1_sub_v, ar
 	//=========================================================
 	//LUT�ֿ��з���ļ���ֵ
 	//// (1) Interpolation - up_DEM
-	fmat swdr_lut_dem1_mat = swdr_lut_tile.rows(span(idx_up_dem, idx_up_dem + idx_filter_dem - 1));
-	fvec swdr_dir_lut_dem1_v = swdr_dir_lut_tile.rows(span(idx_up_dem, idx_up_dem + idx_filter_dem - 1));
-	fmat par_lut_dem1_mat = par_lut_tile.rows(span(idx_up_dem, idx_up_dem + idx_filter_dem - 1));
-	fvec par_dir_lut_dem1_v = par_dir_lut_tile.rows(span(idx_up_dem, idx_up_dem + idx_filter_dem - 1));
-	fmat uva_lut_dem1_mat = uva_lut_tile.rows(span(idx_up_dem, idx_up_dem + idx_filter_dem - 1));
-	fmat uvb_lut_dem1_mat = uvb_lut_tile.rows(span(idx_up_dem, idx_up_dem + idx_filter_dem - 1));
-	fmat toa_up_flux_lut_dem1_mat = toa_up_flux_lut_tile.rows(span(idx_up_dem, idx_up_dem + idx_filter_dem - 1));
-	fvec rho_lut_dem1_v = f_rho(span(idx_up_dem, idx_up_dem + idx_filter_dem - 1));
-	fvec COD_dem1_v = COD(span(idx_up_dem, idx_up_dem + idx_filter_dem - 1));
-
-	// (2) Interpolation - dw_DEM
-	fmat swdr_lut_dem2_mat = swdr_lut_tile.rows(span(idx_dw_dem, idx_dw_dem + idx_filter_dem - 1));
-	fvec swdr_dir_lut_dem2_v = swdr_dir_lut_tile.rows(span(idx_dw_dem, idx_dw_dem + idx_filter_dem - 1));
-	fmat par_lut_dem2_mat = par_lut_tile.rows(span(idx_dw_dem, idx_dw_dem + idx_filter_dem - 1));
-	fvec par_dir_lut_dem2_v = par_dir_lut_tile.rows(span(idx_dw_dem, idx_dw_dem + idx_filter_dem - 1));
-	fmat uva_lut_dem2_mat = uva_lut_tile.rows(span(idx_dw_dem, idx_dw_dem + idx_filter_dem - 1));
-	fmat uvb_lut_dem2_mat = uvb_lut_tile.rows(span(idx_dw_dem, idx_dw_dem + idx_filter_dem - 1));
-	fmat toa_up_flux_lut_dem2_mat = toa_up_flux_lut_tile.rows(span(idx_dw_dem, idx_dw_dem + idx_filter_dem - 1));
-	fvec rho_lut_dem2_v = f_rho(span(idx_dw_dem, idx_dw_dem + idx_filter_dem - 1));
-	fvec COD_dem2_v = COD(span(idx_dw_dem, idx_dw_dem + idx_filter_dem - 1));
+	//the direct SWDR/PAR, rho and COD of the candidate rows are read from the cell of each pixel in lut
 
 	//��ѩ�ʹ����ֿ�=======================================
 	//dem1-------------------------------------------------
@@ -1932,6 +2145,8 @@ int ahi_swdr::interp_dem(arma::fvec& dem_sub_v, arma::fvec& toa_rad_b1_sub_v, ar
 	for (uword i = 0; i < toa_rad_b3_sub_v.n_rows; i++)
 	{
 		int toa_avg_num = m_toa_avg_num;
+		//slice of the cell of the pixel in lut
+		const uword cell = pixel_cell(i);
 
 		//-------------------------------------------------------
 		//�۲�ֵ
@@ -1946,6 +2161,8 @@ int ahi_swdr::interp_dem(arma::fvec& dem_sub_v, arma::fvec& toa_rad_b1_sub_v, ar
 		float ref_band6 = ref_band6_sub_v(i);
 		float ref_band7 = ref_band7_sub_v(i);
 		float sza = sza_sub_v(i);
+		float sw_albedo = sw_albedo_sub_v(i);
+		float vis_albedo = vis_albedo_sub_v(i);
 
 		//////-----����ÿ�����ε�toa_radiance---------
 		//-----dem1---------------------------
@@ -1969,13 +2186,6 @@ int ahi_swdr::interp_dem(arma::fvec& dem_sub_v, arma::fvec& toa_rad_b1_sub_v, ar
 		fvec finded_toa_rad_band6_dem1 = finded_toa_rad_band6_dem1_mat.col(i);
 		fvec finded_toa_rad_band7_dem1 = finded_toa_rad_band7_dem1_mat.col(i);
 
-		////�ܷ���
-		fvec swdr_lut_dem1 = swdr_lut_dem1_mat.col(i);
-		fvec par_lut_dem1 = par_lut_dem1_mat.col(i);
-		fvec uva_lut_dem1 = uva_lut_dem1_mat.col(i);
-		fvec uvb_lut_dem1 = uvb_lut_dem1_mat.col(i);
-		fvec toa_up_flux_lut_dem1 = toa_up_flux_lut_dem1_mat.col(i);
-
 		//-----dem2---------------------------
 		//��ѩtoa_rad
 		fvec toa_rad_ndsi_dem2 = toa_rad_ndsi_dem2_mat.col(i);
@@ -1996,19 +2206,12 @@ int ahi_swdr::interp_dem(arma::fvec& dem_sub_v, arma::fvec& toa_rad_b1_sub_v, ar
 		fvec finded_toa_rad_band3_dem2 = finded_toa_rad_band3_dem2_mat.col(i);
 		fvec finded_toa_rad_band6_dem2 = finded_toa_rad_band6_dem2_mat.col(i);
 		fvec finded_toa_rad_band7_dem2 = finded_toa_rad_band7_dem2_mat.col(i);
-		
-		////�ܷ���
-		fvec swdr_lut_dem2 = swdr_lut_dem2_mat.col(i);
-		fvec par_lut_dem2 = par_lut_dem2_mat.col(i);
-		fvec uva_lut_dem2 = uva_lut_dem2_mat.col(i);
-		fvec uvb_lut_dem2 = uvb_lut_dem2_mat.col(i);
-		fvec toa_up_flux_lut_dem2 = toa_up_flux_lut_dem2_mat.col(i);
 
 		//========================================================================
 		//���ݻ�ѩָ���ֿ�
 		float vstd_ndsi = stddev(toa_rad_ndsi_lut_tile.col(i));
 
-		uvec idx_snow_dem1 = find(toa_rad_ndsi_dem1 <= (lut_diff_max + 5 * vstd_ndsi) && toa_rad_ndsi_dem1 >= (lut_diff_min - 5 * vstd_ndsi)); //��ѩ�ֿ����
+		uvec idx_snow_dem1 = find(toa_rad_ndsi_dem1 <= (lut_diff_max(i) + 5 * vstd_ndsi) && toa_rad_ndsi_dem1 >= (lut_diff_min(i) - 5 * vstd_ndsi)); //��ѩ�ֿ����
 		//
 		if (idx_snow_dem1.n_elem == 0)
 		{
@@ -2027,19 +2230,16 @@ int ahi_swdr::interp_dem(arma::fvec& dem_sub_v, arma::fvec& toa_rad_b1_sub_v, ar
 		finded_toa_rad_band6_dem1 = finded_toa_rad_band6_dem1(idx_snow_dem1);
 		finded_toa_rad_band7_dem1 = finded_toa_rad_band7_dem1(idx_snow_dem1);
 		
-		swdr_lut_dem1 = swdr_lut_dem1(idx_snow_dem1);
-		fvec swdr_dir_lut_dem1 = swdr_dir_lut_dem1_v(idx_snow_dem1);
-		par_lut_dem1 = par_lut_dem1(idx_snow_dem1);
-		fvec par_dir_lut_dem1 = par_dir_lut_dem1_v(idx_snow_dem1);
-		uva_lut_dem1 = uva_lut_dem1(idx_snow_dem1);
-		uvb_lut_dem1 = uvb_lut_dem1(idx_snow_dem1);
-		toa_up_flux_lut_dem1 = toa_up_flux_lut_dem1(idx_snow_dem1);
-		fvec rho_lut_dem1 = rho_lut_dem1_v(idx_snow_dem1);
-		fvec COD_dem1 = COD_dem1_v(idx_snow_dem1);
+		//LUT rows of the candidates, the fluxes are computed at the rows finally matched only
+		const uvec rows_dem1 = idx_up_dem + idx_snow_dem1;
+		fvec swdr_dir_lut_dem1 = quantity_rows(lut, LUT_Q_SW_DIR, cell, rows_dem1);
+		fvec par_dir_lut_dem1 = quantity_rows(lut, LUT_Q_PAR_DIR, cell, rows_dem1);
+		fvec rho_lut_dem1 = quantity_rows(lut, LUT_Q_SW_RHO, cell, rows_dem1);
+		fvec COD_dem1 = quantity_rows(lut, LUT_Q_COD, cell, rows_dem1);
 
 		//-------------------------------------------------------------------
 		//float vstd2 = stddev(toa_rad_ndsi_dem2);
-		uvec idx_snow_dem2 = find(toa_rad_ndsi_dem2 <= (lut_diff_max + 5 * vstd_ndsi) && toa_rad_ndsi_dem2 >= (lut_diff_min - 5 * vstd_ndsi));
+		uvec idx_snow_dem2 = find(toa_rad_ndsi_dem2 <= (lut_diff_max(i) + 5 * vstd_ndsi) && toa_rad_ndsi_dem2 >= (lut_diff_min(i) - 5 * vstd_ndsi));
 		//
 		if (idx_snow_dem2.n_elem == 0)
 		{
@@ -2058,15 +2258,12 @@ int ahi_swdr::interp_dem(arma::fvec& dem_sub_v, arma::fvec& toa_rad_b1_sub_v, ar
 		finded_toa_rad_band6_dem2 = finded_toa_rad_band6_dem2(idx_snow_dem2);
 		finded_toa_rad_band7_dem2 = finded_toa_rad_band7_dem2(idx_snow_dem2);
 		
-		swdr_lut_dem2 = swdr_lut_dem2(idx_snow_dem2);
-		fvec swdr_dir_lut_dem2 = swdr_dir_lut_dem2_v(idx_snow_dem2);
-		par_lut_dem2 = par_lut_dem2(idx_snow_dem2);
-		fvec par_dir_lut_dem2 = par_dir_lut_dem2_v(idx_snow_dem2);
-		uva_lut_dem2 = uva_lut_dem2(idx_snow_dem2);
-		uvb_lut_dem2 = uvb_lut_dem2(idx_snow_dem2);
-		toa_up_flux_lut_dem2 = toa_up_flux_lut_dem2(idx_snow_dem2);
-		fvec rho_lut_dem2 = rho_lut_dem2_v(idx_snow_dem2);
-		fvec COD_dem2 = COD_dem2_v(idx_snow_dem2);
+		//LUT rows of the candidates, the fluxes are computed at the rows finally matched only
+		const uvec rows_dem2 = idx_dw_dem + idx_snow_dem2;
+		fvec swdr_dir_lut_dem2 = quantity_rows(lut, LUT_Q_SW_DIR, cell, rows_dem2);
+		fvec par_dir_lut_dem2 = quantity_rows(lut, LUT_Q_PAR_DIR, cell, rows_dem2);
+		fvec rho_lut_dem2 = quantity_rows(lut, LUT_Q_SW_RHO, cell, rows_dem2);
+		fvec COD_dem2 = quantity_rows(lut, LUT_Q_COD, cell, rows_dem2);
 
 		//========================================================================
 		//�۲�ֵtoa_rad
@@ -2321,7 +2518,7 @@ int ahi_swdr::interp_dem(arma::fvec& dem_sub_v, arma::fvec& toa_rad_b1_sub_v, ar
 		{
 			idx_total = idx2;
 		}
-		fvec swdr_dem1 = swdr_lut_dem1(idx_total);		
+		fvec swdr_dem1 = flux_rows(lut, LUT_Q_SW_F0, LUT_Q_SW_RHO, LUT_Q_SW_CPLX, pixel_cell(i), sw_albedo, rows_dem1(idx_total));		
 		fvec rho_dem1 = rho_lut_dem1(idx_total);
 		//
 		float vmean = mean(swdr_dem1);
@@ -2342,7 +2539,7 @@ int ahi_swdr::interp_dem(arma::fvec& dem_sub_v, arma::fvec& toa_rad_b1_sub_v, ar
 
 		//------------------------------------
 		//---dir_dem1----
-		swdr_dem1 = swdr_lut_dem1(idx_dir);
+		swdr_dem1 = flux_rows(lut, LUT_Q_SW_F0, LUT_Q_SW_RHO, LUT_Q_SW_CPLX, pixel_cell(i), sw_albedo, rows_dem1(idx_dir));
 		fvec dir_dem1 = swdr_dir_lut_dem1(idx_dir);
 
 		vmean = mean(swdr_dem1);
@@ -2360,7 +2557,7 @@ int ahi_swdr::interp_dem(arma::fvec& dem_sub_v, arma::fvec& toa_rad_b1_sub_v, ar
 
 		//------------------------------------
 		//---par_dem1----
-		fvec par_dem1 = par_lut_dem1(idx_total);
+		fvec par_dem1 = flux_rows(lut, LUT_Q_PAR_F0, LUT_Q_PAR_RHO, LUT_Q_PAR_CPLX, pixel_cell(i), vis_albedo, rows_dem1(idx_total));
 
 		vmean = mean(par_dem1);
 		vstd = stddev(par_dem1) * f_std;
@@ -2377,7 +2574,7 @@ int ahi_swdr::interp_dem(arma::fvec& dem_sub_v, arma::fvec& toa_rad_b1_sub_v, ar
 
 		//------------------------------------
 		//---par_dir_dem1----
-		par_dem1 = par_lut_dem1(idx_dir);
+		par_dem1 = flux_rows(lut, LUT_Q_PAR_F0, LUT_Q_PAR_RHO, LUT_Q_PAR_CPLX, pixel_cell(i), vis_albedo, rows_dem1(idx_dir));
 		fvec par_dir_dem1 = par_dir_lut_dem1(idx_dir);
 
 		vmean = mean(par_dem1);
@@ -2395,7 +2592,7 @@ int ahi_swdr::interp_dem(arma::fvec& dem_sub_v, arma::fvec& toa_rad_b1_sub_v, ar
 
 		//------------------------------------
 		//-uva_dem1--
-		fvec uva_dem1 = uva_lut_dem1(idx_total);
+		fvec uva_dem1 = flux_rows(lut, LUT_Q_UVA_F0, LUT_Q_UVA_RHO, LUT_Q_UVA_CPLX, pixel_cell(i), vis_albedo, rows_dem1(idx_total));
 
 		vmean = mean(uva_dem1);
 		vstd = stddev(uva_dem1) * f_std;
@@ -2412,7 +2609,7 @@ int ahi_swdr::interp_dem(arma::fvec& dem_sub_v, arma::fvec& toa_rad_b1_sub_v, ar
 
 		//------------------------------------
 		//-uvb_dem1--
-		fvec uvb_dem1 = uvb_lut_dem1(idx_total);
+		fvec uvb_dem1 = flux_rows(lut, LUT_Q_UVB_F0, LUT_Q_UVB_RHO, LUT_Q_UVB_CPLX, pixel_cell(i), vis_albedo, rows_dem1(idx_total));
 
 		vmean = mean(uvb_dem1);
 		vstd = stddev(uvb_dem1) * f_std;
@@ -2429,7 +2626,7 @@ int ahi_swdr::interp_dem(arma::fvec& dem_sub_v, arma::fvec& toa_rad_b1_sub_v, ar
 
 		//------------------------------------
 		//-toa_albedo_dem1--
-		fvec toa_up_flux_dem1 = toa_up_flux_lut_dem1(idx_total);
+		fvec toa_up_flux_dem1 = toa_rows(lut, LUT_Q_ALB_F0, LUT_Q_ALB_RHO, LUT_Q_ALB_CPLX, LUT_Q_TOA_DW_FLUX, pixel_cell(i), sw_albedo, rows_dem1(idx_total));
 
 		vmean = mean(toa_up_flux_dem1);
 		vstd = stddev(toa_up_flux_dem1) * f_std;
@@ -2613,7 +2810,7 @@ int ahi_swdr::interp_dem(arma::fvec& dem_sub_v, arma::fvec& toa_rad_b1_sub_v, ar
 			idx_total = idx2;
 		}
 		//----swdr-dem2----
-		fvec swdr_dem2 = swdr_lut_dem2(idx_total);
+		fvec swdr_dem2 = flux_rows(lut, LUT_Q_SW_F0, LUT_Q_SW_RHO, LUT_Q_SW_CPLX, pixel_cell(i), sw_albedo, rows_dem2(idx_total));
 		fvec rho_dem2 = rho_lut_dem2(idx_total);
 		//
 		vmean = mean(swdr_dem2);
@@ -2633,7 +2830,7 @@ int ahi_swdr::interp_dem(arma::fvec& dem_sub_v, arma::fvec& toa_rad_b1_sub_v, ar
 
 		//------------------------------------
 		//---dir_dem2----
-		swdr_dem2 = swdr_lut_dem2(idx_dir);
+		swdr_dem2 = flux_rows(lut, LUT_Q_SW_F0, LUT_Q_SW_RHO, LUT_Q_SW_CPLX, pixel_cell(i), sw_albedo, rows_dem2(idx_dir));
 		fvec dir_dem2 = swdr_dir_lut_dem2(idx_dir);
 
 		vmean = mean(swdr_dem2);
@@ -2651,7 +2848,7 @@ int ahi_swdr::interp_dem(arma::fvec& dem_sub_v, arma::fvec& toa_rad_b1_sub_v, ar
 
 		//------------------------------------
 		//---par_dem2----
-		fvec par_dem2 = par_lut_dem2(idx_total);
+		fvec par_dem2 = flux_rows(lut, LUT_Q_PAR_F0, LUT_Q_PAR_RHO, LUT_Q_PAR_CPLX, pixel_cell(i), vis_albedo, rows_dem2(idx_total));
 
 		vmean = mean(par_dem2);
 		vstd = stddev(par_dem2) * f_std;
@@ -2668,7 +2865,7 @@ int ahi_swdr::interp_dem(arma::fvec& dem_sub_v, arma::fvec& toa_rad_b1_sub_v, ar
 
 		//------------------------------------
 		//---par_dir_dem2----
-		par_dem2 = par_lut_dem2(idx_dir);
+		par_dem2 = flux_rows(lut, LUT_Q_PAR_F0, LUT_Q_PAR_RHO, LUT_Q_PAR_CPLX, pixel_cell(i), vis_albedo, rows_dem2(idx_dir));
 		fvec par_dir_dem2 = par_dir_lut_dem2(idx_dir);
 
 		vmean = mean(par_dem2);
@@ -2686,7 +2883,7 @@ int ahi_swdr::interp_dem(arma::fvec& dem_sub_v, arma::fvec& toa_rad_b1_sub_v, ar
 
 		//------------------------------------
 		//-uva_dem2--
-		fvec uva_dem2 = uva_lut_dem2(idx_total);
+		fvec uva_dem2 = flux_rows(lut, LUT_Q_UVA_F0, LUT_Q_UVA_RHO, LUT_Q_UVA_CPLX, pixel_cell(i), vis_albedo, rows_dem2(idx_total));
 
 		vmean = mean(uva_dem2);
 		vstd = stddev(uva_dem2) * f_std;
@@ -2703,7 +2900,7 @@ int ahi_swdr::interp_dem(arma::fvec& dem_sub_v, arma::fvec& toa_rad_b1_sub_v, ar
 
 		//------------------------------------
 		//-uvb_dem2--
-		fvec uvb_dem2 = uvb_lut_dem2(idx_total);
+		fvec uvb_dem2 = flux_rows(lut, LUT_Q_UVB_F0, LUT_Q_UVB_RHO, LUT_Q_UVB_CPLX, pixel_cell(i), vis_albedo, rows_dem2(idx_total));
 
 		vmean = mean(uvb_dem2);
 		vstd = stddev(uvb_dem2) * f_std;
@@ -2719,7 +2916,7 @@ int ahi_swdr::interp_dem(arma::fvec& dem_sub_v, arma::fvec& toa_rad_b1_sub_v, ar
 
 		//------------------------------------
 		//-toa_albedo_dem2--
-		fvec toa_up_flux_dem2 = toa_up_flux_lut_dem2(idx_total);
+		fvec toa_up_flux_dem2 = toa_rows(lut, LUT_Q_ALB_F0, LUT_Q_ALB_RHO, LUT_Q_ALB_CPLX, LUT_Q_TOA_DW_FLUX, pixel_cell(i), sw_albedo, rows_dem2(idx_total));
 
 		vmean = mean(toa_up_flux_dem2);
 		vstd = stddev(toa_up_flux_dem2) * f_std;
@@ -2736,29 +2933,38 @@ int ahi_swdr::interp_dem(arma::fvec& dem_sub_v, arma::fvec& toa_rad_b1_sub_v, ar
 	}
 ////----------------------------------------------
 
-	fvec slope = (finded_swdr_sub_v_dem1 - finded_swdr_sub_v_dem2) / (m_up_dem - m_dw_dem);
-	itp_swdr = finded_swdr_sub_v_dem2 + slope % (dem_sub_v - m_dw_dem);
+	//DEM nodes of the cell of every pixel
+	fvec dw_dem_v(dem_sub_v.n_elem);
+	fvec up_dem_v(dem_sub_v.n_elem);
+	for (uword i = 0; i < dem_sub_v.n_elem; i++)
+	{
+		dw_dem_v(i) = lut.cells[pixel_cell(i)].dw_dem;
+		up_dem_v(i) = lut.cells[pixel_cell(i)].up_dem;
+	}
+
+	fvec slope = (finded_swdr_sub_v_dem1 - finded_swdr_sub_v_dem2) / (up_dem_v - dw_dem_v);
+	itp_swdr = finded_swdr_sub_v_dem2 + slope % (dem_sub_v - dw_dem_v);
 
-	slope = (finded_swdr_dir_sub_v_dem1 - finded_swdr_dir_sub_v_dem2) / (m_up_dem - m_dw_dem);
-	itp_swdir = finded_swdr_dir_sub_v_dem2 + slope % (dem_sub_v - m_dw_dem);
+	slope = (finded_swdr_dir_sub_v_dem1 - finded_swdr_dir_sub_v_dem2) / (up_dem_v - dw_dem_v);
+	itp_swdir = finded_swdr_dir_sub_v_dem2 + slope % (dem_sub_v - dw_dem_v);
 
-	slope = (finded_par_sub_v_dem1 - finded_par_sub_v_dem2) / (m_up_dem - m_dw_dem);
-	itp_par = finded_par_sub_v_dem2 + slope % (dem_sub_v - m_dw_dem);
+	slope = (finded_par_sub_v_dem1 - finded_par_sub_v_dem2) / (up_dem_v - dw_dem_v);
+	itp_par = finded_par_sub_v_dem2 + slope % (dem_sub_v - dw_dem_v);
 
-	slope = (finded_par_dir_sub_v_dem1 - finded_par_dir_sub_v_dem2) / (m_up_dem - m_dw_dem);
-	itp_pardir = finded_par_dir_sub_v_dem2 + slope % (dem_sub_v - m_dw_dem);
+	slope = (finded_par_dir_sub_v_dem1 - finded_par_dir_sub_v_dem2) / (up_dem_v - dw_dem_v);
+	itp_pardir = finded_par_dir_sub_v_dem2 + slope % (dem_sub_v - dw_dem_v);
 
-	slope = (finded_uva_sub_v_dem1 - finded_uva_sub_v_dem2) / (m_up_dem - m_dw_dem);
-	itp_uva = finded_uva_sub_v_dem2 + slope % (dem_sub_v - m_dw_dem);
+	slope = (finded_uva_sub_v_dem1 - finded_uva_sub_v_dem2) / (up_dem_v - dw_dem_v);
+	itp_uva = finded_uva_sub_v_dem2 + slope % (dem_sub_v - dw_dem_v);
 
-	slope = (finded_uvb_sub_v_dem1 - finded_uvb_sub_v_dem2) / (m_up_dem - m_dw_dem);
-	itp_uvb = finded_uvb_sub_v_dem2 + slope % (dem_sub_v - m_dw_dem);
+	slope = (finded_uvb_sub_v_dem1 - finded_uvb_sub_v_dem2) / (up_dem_v - dw_dem_v);
+	itp_uvb = finded_uvb_sub_v_dem2 + slope % (dem_sub_v - dw_dem_v);
 
-	slope = (finded_toa_up_flux_sub_v_dem1 - finded_toa_up_flux_sub_v_dem2) / (m_up_dem - m_dw_dem);
-	itp_toa_up_flux = finded_toa_up_flux_sub_v_dem2 + slope % (dem_sub_v - m_dw_dem);
+	slope = (finded_toa_up_flux_sub_v_dem1 - finded_toa_up_flux_sub_v_dem2) / (up_dem_v - dw_dem_v);
+	itp_toa_up_flux = finded_toa_up_flux_sub_v_dem2 + slope % (dem_sub_v - dw_dem_v);
 
-	slope = (finded_rho_sub_v_dem1 - finded_rho_sub_v_dem2) / (m_up_dem - m_dw_dem);
-	itp_rho = finded_rho_sub_v_dem2 + slope % (dem_sub_v - m_dw_dem);
+	slope = (finded_rho_sub_v_dem1 - finded_rho_sub_v_dem2) / (up_dem_v - dw_dem_v);
+	itp_rho = finded_rho_sub_v_dem2 + slope % (dem_sub_v - dw_dem_v);
 
 	return 0;
 }
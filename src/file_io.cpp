@@ -180,6 +180,170 @@ int write_3d_geotif(const arma::Cube<short>& data, const imageGeoInfo& geoinfo,
 	return 0;
 }
 
+
+imageStripReader::~imageStripReader()
+{
+	if (m_dataset != nullptr)
+		GDALClose(static_cast<GDALDatasetH>(m_dataset));
+}
+
+int imageStripReader::open(const std::string& filename)
+{
+	using namespace std;
+
+	GDALAllRegister();
+
+	m_dataset = static_cast<GDALDataset *>(GDALOpen(filename.c_str(), GA_ReadOnly));
+	if (m_dataset == nullptr)
+	{
+		cout << "Can not read image file: " << filename << endl;
+		return 1;
+	}
+
+	m_nrows = m_dataset->GetRasterYSize();
+	m_ncols = m_dataset->GetRasterXSize();
+	m_nbands = m_dataset->GetRasterCount();
+
+	if (m_nbands < 2)
+	{
+		cout << "Error: this raster should have more than one band!\n";
+		cout << "in " << filename << endl;
+		return 1;
+	}
+
+	return 0;
+}
+
+int imageStripReader::read_rows(int row_st, int nrows, int nbands, arma::fcube& data) const
+{
+	using namespace std;
+
+	if (nbands == 0) nbands = m_nbands;
+	if (m_dataset == nullptr || row_st < 0 || nrows < 0 || row_st + nrows > m_nrows || nbands > m_nbands)
+	{
+		cout << "[Error] cannot read rows " << row_st << " + " << nrows << " of the image.\n";
+		return 1;
+	}
+
+	data.set_size(nrows, m_ncols, nbands);
+	arma::fmat tmp(m_ncols, nrows);
+	for (int ib = 0; ib < nbands; ++ib)
+	{
+		GDALRasterBand* pBand = m_dataset->GetRasterBand(ib + 1);
+		CPLErr ret = pBand->RasterIO(GF_Read, 0, row_st, m_ncols, nrows,
+		                             tmp.memptr(), m_ncols, nrows, GDT_Float32, 0, 0, nullptr);
+		if (ret == CE_Failure)
+		{
+			cout << "Cannot read the data.\n";
+			return 1;
+		}
+
+		data.slice(ib) = tmp.t();
+	}
+
+	return 0;
+}
+
+
+imageStripWriter::~imageStripWriter()
+{
+	close();
+}
+
+int imageStripWriter::open(const std::string& out_fn, int nrows, int ncols, int nbands, const imageGeoInfo& geoinfo)
+{
+	const short fillvalue = -1;
+
+	GDALAllRegister();
+
+	double geoTrans[6];
+	geoinfo.getGeoTrans(geoTrans);
+
+	std::string proj;
+	geoinfo.getProjInfo(proj);
+
+	const char* pszFormat = "GTiff";
+	GDALDriver* poDriver = GetGDALDriverManager()->GetDriverByName(pszFormat);
+	if (poDriver == nullptr)
+	{
+		printf("[Error] GDAL does't support data format %s. \n", pszFormat);
+		return 1;
+	}
+
+	char** papszOptions = nullptr;
+	papszOptions = CSLSetNameValue(papszOptions, "INTERLEAVE", "BAND");
+	papszOptions = CSLSetNameValue(papszOptions, "COMPRESS", "LZW");
+
+	m_dataset = poDriver->Create(out_fn.c_str(), ncols, nrows, nbands, GDT_Int16, papszOptions);
+	CSLDestroy(papszOptions);
+	if (m_dataset == nullptr)
+	{
+		printf("[Error] GDAL dataset cannot be created.\n");
+		return 1;
+	}
+
+	if (proj.length() > 0)
+	{
+		m_dataset->SetProjection(proj.c_str());
+		m_dataset->SetGeoTransform(geoTrans);
+	}
+
+	for (int ib = 0; ib < nbands; ++ib)
+		m_dataset->GetRasterBand(ib + 1)->SetNoDataValue(fillvalue);
+
+	return 0;
+}
+
+int imageStripWriter::write_rows(int row_st, const arma::Cube<short>& data)
+{
+	if (m_dataset == nullptr) return 1;
+
+	const int nrows = data.n_rows;
+	const int ncols = data.n_cols;
+	const int nbnds = data.n_slices;
+
+	for (int ib = 0; ib < nbnds; ++ib)
+	{
+		arma::Mat<short> band_data = data.slice(ib).t();
+
+		GDALRasterBand* pBand = m_dataset->GetRasterBand(ib + 1);
+		CPLErr ret = pBand->RasterIO(GF_Write, 0, row_st, ncols, nrows,
+		                             band_data.memptr(), ncols, nrows, GDT_Int16, 0, 0, nullptr);
+		if (ret == CE_Failure)
+		{
+			printf("Cannot write the data.\n");
+			return 1;
+		}
+	} // endfor ib
+
+	return 0;
+}
+
+int imageStripWriter::close()
+{
+	if (m_dataset == nullptr) return 0;
+
+	//LZW strips still cached are encoded and written here, so check for errors before and at close
+	CPLErrorReset();
+	m_dataset->FlushCache();
+	bool failed = CPLGetLastErrorType() >= CE_Failure;
+#if GDAL_VERSION_NUM >= GDAL_COMPUTE_VERSION(3, 8, 0)
+	if (GDALClose(static_cast<GDALDatasetH>(m_dataset)) != CE_None) failed = true;
+#else
+	GDALClose(static_cast<GDALDatasetH>(m_dataset));
+	if (CPLGetLastErrorType() >= CE_Failure) failed = true;
+#endif
+	m_dataset = nullptr;
+
+	if (failed)
+	{
+		printf("[Error] Cannot flush the output file: %s\n", CPLGetLastErrorMsg());
+		return 1;
+	}
+	return 0;
+}
+
+
 imageGeoInfo::imageGeoInfo(const std::string& in_file)
 {
 	int ok = readImageInfo(in_file);
@@ -0,0 +1,180 @@
+#include "forward_kernel.h"
+
+#include <string>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SWDR_FORWARD_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	// NDSI scales of the band 4 and band 6 radiances
+	const float NDSI_SCALE_B4 = 593.84f;
+	const float NDSI_SCALE_B6 = 76.53f;
+
+	// rows [st, nrows) one by one
+	void forward_rows_scalar(const ForwardColumns& lut, const float inv_ref[FWD_BAND_NUM], size_t st, size_t nrows,
+		float* const out[FWD_OUT_NUM])
+	{
+		for (size_t r = st; r < nrows; r++)
+		{
+			float rad[FWD_BAND_NUM];
+			for (int b = 0; b < FWD_BAND_NUM; b++)
+				rad[b] = lut.i0[b][r] + (1 / (inv_ref[b] - lut.rho[b][r])) * lut.cplx[b][r];
+
+			out[FWD_OUT_B1][r] = rad[FWD_B1];
+			out[FWD_OUT_B3][r] = rad[FWD_B3];
+			out[FWD_OUT_B6][r] = rad[FWD_B6];
+			out[FWD_OUT_B7][r] = rad[FWD_B7];
+
+			const float b4 = rad[FWD_B4] / NDSI_SCALE_B4;
+			const float b6 = rad[FWD_B6] / NDSI_SCALE_B6;
+			out[FWD_OUT_NDSI][r] = (b4 - b6) / (b4 + b6);
+		}
+	}
+
+	void forward_scalar(const ForwardColumns& lut, const float inv_ref[FWD_BAND_NUM], size_t nrows,
+		float* const out[FWD_OUT_NUM])
+	{
+		forward_rows_scalar(lut, inv_ref, 0, nrows, out);
+	}
+
+#ifdef SWDR_FORWARD_X86
+	// 8 rows per step; this file is built with -ffp-contract=off, so that no mul + add becomes an FMA
+	// and the roundings are those of the scalar code
+	__attribute__((target("avx2")))
+	void forward_avx2(const ForwardColumns& lut, const float inv_ref[FWD_BAND_NUM], size_t nrows,
+		float* const out[FWD_OUT_NUM])
+	{
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 scale_b4 = _mm256_set1_ps(NDSI_SCALE_B4);
+		const __m256 scale_b6 = _mm256_set1_ps(NDSI_SCALE_B6);
+		__m256 inv[FWD_BAND_NUM];
+		for (int b = 0; b < FWD_BAND_NUM; b++)
+			inv[b] = _mm256_set1_ps(inv_ref[b]);
+
+		size_t r = 0;
+		for (; r + 8 <= nrows; r += 8)
+		{
+			__m256 rad[FWD_BAND_NUM];
+			for (int b = 0; b < FWD_BAND_NUM; b++)
+			{
+				const __m256 i0x = _mm256_sub_ps(inv[b], _mm256_loadu_ps(lut.rho[b] + r));
+				rad[b] = _mm256_add_ps(_mm256_loadu_ps(lut.i0[b] + r),
+					_mm256_mul_ps(_mm256_div_ps(one, i0x), _mm256_loadu_ps(lut.cplx[b] + r)));
+			}
+
+			_mm256_storeu_ps(out[FWD_OUT_B1] + r, rad[FWD_B1]);
+			_mm256_storeu_ps(out[FWD_OUT_B3] + r, rad[FWD_B3]);
+			_mm256_storeu_ps(out[FWD_OUT_B6] + r, rad[FWD_B6]);
+			_mm256_storeu_ps(out[FWD_OUT_B7] + r, rad[FWD_B7]);
+
+			const __m256 b4 = _mm256_div_ps(rad[FWD_B4], scale_b4);
+			const __m256 b6 = _mm256_div_ps(rad[FWD_B6], scale_b6);
+			_mm256_storeu_ps(out[FWD_OUT_NDSI] + r, _mm256_div_ps(_mm256_sub_ps(b4, b6), _mm256_add_ps(b4, b6)));
+		}
+		forward_rows_scalar(lut, inv_ref, r, nrows, out);
+	}
+
+	// 16 rows per step, the last rows masked
+	__attribute__((target("avx512f")))
+	void forward_avx512(const ForwardColumns& lut, const float inv_ref[FWD_BAND_NUM], size_t nrows,
+		float* const out[FWD_OUT_NUM])
+	{
+		const __m512 one = _mm512_set1_ps(1.0f);
+		const __m512 scale_b4 = _mm512_set1_ps(NDSI_SCALE_B4);
+		const __m512 scale_b6 = _mm512_set1_ps(NDSI_SCALE_B6);
+		__m512 inv[FWD_BAND_NUM];
+		for (int b = 0; b < FWD_BAND_NUM; b++)
+			inv[b] = _mm512_set1_ps(inv_ref[b]);
+
+		for (size_t r = 0; r < nrows; r += 16)
+		{
+			const __mmask16 mask = (nrows - r >= 16) ? __mmask16(0xFFFF) : __mmask16((1u << (nrows - r)) - 1);
+
+			__m512 rad[FWD_BAND_NUM];
+			for (int b = 0; b < FWD_BAND_NUM; b++)
+			{
+				const __m512 i0x = _mm512_sub_ps(inv[b], _mm512_maskz_loadu_ps(mask, lut.rho[b] + r));
+				rad[b] = _mm512_add_ps(_mm512_maskz_loadu_ps(mask, lut.i0[b] + r),
+					_mm512_mul_ps(_mm512_div_ps(one, i0x), _mm512_maskz_loadu_ps(mask, lut.cplx[b] + r)));
+			}
+
+			_mm512_mask_storeu_ps(out[FWD_OUT_B1] + r, mask, rad[FWD_B1]);
+			_mm512_mask_storeu_ps(out[FWD_OUT_B3] + r, mask, rad[FWD_B3]);
+			_mm512_mask_storeu_ps(out[FWD_OUT_B6] + r, mask, rad[FWD_B6]);
+			_mm512_mask_storeu_ps(out[FWD_OUT_B7] + r, mask, rad[FWD_B7]);
+
+			const __m512 b4 = _mm512_div_ps(rad[FWD_B4], scale_b4);
+			const __m512 b6 = _mm512_div_ps(rad[FWD_B6], scale_b6);
+			_mm512_mask_storeu_ps(out[FWD_OUT_NDSI] + r, mask, _mm512_div_ps(_mm512_sub_ps(b4, b6), _mm512_add_ps(b4, b6)));
+		}
+	}
+#endif
+
+	typedef void (*ForwardFunc)(const ForwardColumns&, const float*, size_t, float* const*);
+
+	struct ForwardKernel
+	{
+		ForwardFunc func;
+		const char* name;
+	};
+
+	// kernel of the instruction set isa (avx512, avx2 or scalar), false if the CPU lacks it
+	bool find_kernel(const std::string& isa, ForwardKernel& kernel)
+	{
+#ifdef SWDR_FORWARD_X86
+		__builtin_cpu_init();
+		if (isa == "avx512" && __builtin_cpu_supports("avx512f"))
+		{
+			kernel = ForwardKernel{ forward_avx512, "avx512" };
+			return true;
+		}
+		if (isa == "avx2" && __builtin_cpu_supports("avx2"))
+		{
+			kernel = ForwardKernel{ forward_avx2, "avx2" };
+			return true;
+		}
+#endif
+		if (isa == "scalar")
+		{
+			kernel = ForwardKernel{ forward_scalar, "scalar" };
+			return true;
+		}
+		return false;
+	}
+
+	// the widest instruction set of the CPU, chosen once unless forward_kernel_select
+	ForwardKernel& forward_kernel()
+	{
+		static ForwardKernel kernel = []()
+		{
+			ForwardKernel widest{ forward_scalar, "scalar" };
+			if (!find_kernel("avx512", widest)) find_kernel("avx2", widest);
+			return widest;
+		}();
+		return kernel;
+	}
+}
+
+
+void forward_bands(const ForwardColumns& lut, const float inv_ref[FWD_BAND_NUM], size_t nrows,
+	float* const out[FWD_OUT_NUM])
+{
+	forward_kernel().func(lut, inv_ref, nrows, out);
+}
+
+const char* forward_kernel_name()
+{
+	return forward_kernel().name;
+}
+
+int forward_kernel_select(const std::string& isa)
+{
+	ForwardKernel kernel;
+	if (!find_kernel(isa, kernel)) return 1;
+
+	forward_kernel() = kernel;
+	return 0;
+}
@@ -0,0 +1,1844 @@
+//
+#include "lut_store.h"
+
+#include "tbb/parallel_for.h"
+#include "tbb/blocked_range.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+
+#ifdef SWDR_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	const char LUT_MAGIC[8] = { 'S', 'W', 'D', 'R', 'L', 'U', 'T', '\0' };
+	// *.swlutz: the zstd compressed (SZA, VZA) units of a *.swlut file
+	const char LUT_MAGIC_ZSTD[8] = { 'S', 'W', 'D', 'R', 'L', 'U', 'T', 'Z' };
+	const int LUT_ZSTD_LEVEL = 9;
+
+	// columns of the 40-column text LUT:
+	//   0-3 sza, vza, los, dem; 4 cod; 5-19 i0/rho/complex of band 1, 3, 4, 6, 7;
+	//   20-23, 24-27, 28-31, 32-35 dir/dif/rho/complex of sw, par, uva, uvb;
+	//   36-39 alb_f0, alb_rho, alb_complex, toa_dw_flux
+	// quantity -> text column (+ a second text column added to it)
+	struct LutQuantityDef
+	{
+		LutQuantity q;
+		const char* name;
+		int col;
+		int add_col;
+	};
+
+	const LutQuantityDef LUT_QUANTITIES[LUT_Q_NUM] = {
+		{ LUT_Q_COD, "cod", 4, -1 },
+		{ LUT_Q_I0_B1, "i0_b1", 5, -1 }, { LUT_Q_RHO_B1, "rho_b1", 6, -1 }, { LUT_Q_CPLX_B1, "cplx_b1", 7, -1 },
+		{ LUT_Q_I0_B3, "i0_b3", 8, -1 }, { LUT_Q_RHO_B3, "rho_b3", 9, -1 }, { LUT_Q_CPLX_B3, "cplx_b3", 10, -1 },
+		{ LUT_Q_I0_B4, "i0_b4", 11, -1 }, { LUT_Q_RHO_B4, "rho_b4", 12, -1 }, { LUT_Q_CPLX_B4, "cplx_b4", 13, -1 },
+		{ LUT_Q_I0_B6, "i0_b6", 14, -1 }, { LUT_Q_RHO_B6, "rho_b6", 15, -1 }, { LUT_Q_CPLX_B6, "cplx_b6", 16, -1 },
+		{ LUT_Q_I0_B7, "i0_b7", 17, -1 }, { LUT_Q_RHO_B7, "rho_b7", 18, -1 }, { LUT_Q_CPLX_B7, "cplx_b7", 19, -1 },
+		{ LUT_Q_SW_F0, "sw_f0", 20, 21 }, { LUT_Q_SW_DIR, "sw_dir", 20, -1 },
+		{ LUT_Q_SW_RHO, "sw_rho", 22, -1 }, { LUT_Q_SW_CPLX, "sw_cplx", 23, -1 },
+		{ LUT_Q_PAR_F0, "par_f0", 24, 25 }, { LUT_Q_PAR_DIR, "par_dir", 24, -1 },
+		{ LUT_Q_PAR_RHO, "par_rho", 26, -1 }, { LUT_Q_PAR_CPLX, "par_cplx", 27, -1 },
+		{ LUT_Q_UVA_F0, "uva_f0", 28, 29 }, { LUT_Q_UVA_DIR, "uva_dir", 28, -1 },
+		{ LUT_Q_UVA_RHO, "uva_rho", 30, -1 }, { LUT_Q_UVA_CPLX, "uva_cplx", 31, -1 },
+		{ LUT_Q_UVB_F0, "uvb_f0", 32, 33 }, { LUT_Q_UVB_DIR, "uvb_dir", 32, -1 },
+		{ LUT_Q_UVB_RHO, "uvb_rho", 34, -1 }, { LUT_Q_UVB_CPLX, "uvb_cplx", 35, -1 },
+		{ LUT_Q_ALB_F0, "alb_f0", 36, -1 }, { LUT_Q_ALB_RHO, "alb_rho", 37, -1 },
+		{ LUT_Q_ALB_CPLX, "alb_cplx", 38, -1 }, { LUT_Q_TOA_DW_FLUX, "toa_dw_flux", 39, -1 }
+	};
+
+	// version of an existing binary LUT file, 0 if it cannot be read
+	uint32_t lut_file_version(const std::string& bin_file)
+	{
+		LutFileHeader header{};
+		std::ifstream fid(bin_file, std::ios::binary);
+		if (!fid.read(reinterpret_cast<char*>(&header), sizeof(LutFileHeader))) return 0;
+		if (memcmp(header.magic, LUT_MAGIC, sizeof(LUT_MAGIC)) != 0
+			&& memcmp(header.magic, LUT_MAGIC_ZSTD, sizeof(LUT_MAGIC_ZSTD)) != 0) return 0;
+		return header.version;
+	}
+
+	// the axis grids of the config file, in LutAxis order
+	std::vector<arma::fvec> config_axes(const myConfig& cfg)
+	{
+		std::vector<arma::fvec> axes(LUT_AXIS_NUM);
+		axes[LUT_AXIS_SZA] = arma::conv_to<arma::fvec>::from(cfg.sza_list);
+		axes[LUT_AXIS_VZA] = arma::conv_to<arma::fvec>::from(cfg.vza_list);
+		axes[LUT_AXIS_LOS] = arma::conv_to<arma::fvec>::from(cfg.los_list);
+		axes[LUT_AXIS_DEM] = cfg.dem_list;
+		return axes;
+	}
+
+	const char* axis_name(int axis)
+	{
+		static const char* const names[LUT_AXIS_NUM] = { "SZA", "VZA", "LOS", "DEM" };
+		return names[axis];
+	}
+
+	size_t align_page(size_t nbytes)
+	{
+		return (nbytes + LUT_PAGE_SIZE - 1) / LUT_PAGE_SIZE * LUT_PAGE_SIZE;
+	}
+
+	bool is_lut_space(char ch)
+	{
+		return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
+	}
+
+	// parse the numbers of one text row [beg, end) into dst[ic * nrows], ic < ncols
+	int parse_lut_row(const char* beg, const char* end, float* dst, size_t nrows, size_t ncols)
+	{
+		size_t ic = 0;
+		const char* pos = beg;
+		while (true)
+		{
+			while (pos < end && is_lut_space(*pos)) pos++;
+			if (pos == end) break;
+			if (ic == ncols) return 1;
+
+			float val = 0.0f;
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+			const std::from_chars_result ret = std::from_chars(pos, end, val);
+			if (ret.ec != std::errc()) return 1;
+			const char* next = ret.ptr;
+#else
+			// gcc 10 has no from_chars for float, the row always ends with '\n' or '\0'
+			char* next = nullptr;
+			val = strtof(pos, &next);
+			if (next == pos || next > end) return 1;
+#endif
+			if (next < end && !is_lut_space(*next)) return 1;
+
+			dst[ic * nrows] = val;
+			ic++;
+			pos = next;
+		}
+
+		return ic == ncols ? 0 : 1;
+	}
+
+	// seconds to wait for another process that is publishing the shared LUT
+	const int LUT_SHM_WAIT_SECONDS = 120;
+
+	// identity of the LUT file a shared memory segment is copied from, stored behind the copy
+	struct LutShmStamp
+	{
+		uint64_t dev;
+		uint64_t ino;
+		uint64_t size;
+		int64_t mtime_sec;
+		int64_t mtime_nsec;
+	};
+
+	LutShmStamp lut_shm_stamp(const struct stat& st)
+	{
+		LutShmStamp stamp{};
+		stamp.dev = st.st_dev;
+		stamp.ino = st.st_ino;
+		stamp.size = st.st_size;
+		stamp.mtime_sec = st.st_mtim.tv_sec;
+		stamp.mtime_nsec = st.st_mtim.tv_nsec;
+		return stamp;
+	}
+
+	//-------------------------------------------------------------
+	// reduced precision storage
+	const char* const LUT_PRECISION_NAMES[LUT_PRECISION_NUM] = { "float32", "float16", "bfloat16", "int16" };
+	const char* const LUT_HUGE_PAGES_NAMES[LUT_PAGES_NUM] = { "none", "transparent", "explicit" };
+	const char* const LUT_NUMA_NAMES[LUT_NUMA_NUM] = { "none", "interleave", "replicate" };
+
+	// default huge page size of x86-64 and aarch64
+	const size_t LUT_HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+	const int LUT_MAX_NUMA_NODES = 1024;
+
+	// index of name in names, -1 if not found
+	int find_name(const std::string& name, const char* const* names, int num)
+	{
+		for (int ii = 0; ii < num; ii++)
+		{
+			if (name == names[ii]) return ii;
+		}
+		return -1;
+	}
+
+	// id list of /sys/devices/system/node, e.g. "0-3,8,10-11"
+	std::vector<int> read_id_list(const std::string& sys_file)
+	{
+		std::vector<int> ids;
+		std::ifstream fid(sys_file);
+		std::string text;
+		if (!std::getline(fid, text)) return ids;
+
+		std::stringstream ss(text);
+		std::string item;
+		while (std::getline(ss, item, ','))
+		{
+			if (item.empty()) continue;
+			const size_t pos = item.find('-');
+			const int st = atoi(item.c_str());
+			const int ed = pos == std::string::npos ? st : atoi(item.c_str() + pos + 1);
+			for (int id = st; id <= ed; id++)
+				ids.push_back(id);
+		}
+		return ids;
+	}
+
+	// online NUMA nodes, { 0 } without NUMA
+	std::vector<int> numa_nodes()
+	{
+		std::vector<int> nodes = read_id_list("/sys/devices/system/node/online");
+		if (nodes.empty()) nodes.push_back(0);
+		return nodes;
+	}
+
+	int set_numa_policy(void* addr, size_t nbytes, int mode, const std::vector<int>& nodes)
+	{
+		const size_t bits = 8 * sizeof(unsigned long);
+		std::vector<unsigned long> mask(LUT_MAX_NUMA_NODES / bits, 0);
+		for (const int node : nodes)
+		{
+			if (node >= 0 && node < LUT_MAX_NUMA_NODES) mask[node / bits] |= 1UL << (node % bits);
+		}
+		// maxnode + 1 as libnuma, the kernel drops the last bit
+		return syscall(SYS_mbind, addr, nbytes, mode, mask.data(), LUT_MAX_NUMA_NODES + 1, 0) == 0 ? 0 : 1;
+	}
+
+	// anonymous memory of at least nbytes for the resident LUT, aligned to the huge page size
+	void* map_anonymous(size_t nbytes, LutHugePages pages, size_t& map_bytes, std::string& used)
+	{
+		map_bytes = (nbytes + LUT_HUGE_PAGE_SIZE - 1) / LUT_HUGE_PAGE_SIZE * LUT_HUGE_PAGE_SIZE;
+
+		if (pages == LUT_PAGES_EXPLICIT)
+		{
+			void* addr = mmap(nullptr, map_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (addr != MAP_FAILED)
+			{
+				used = "explicit huge pages";
+				return addr;
+			}
+			pages = LUT_PAGES_TRANSPARENT;
+			used = "no free explicit huge pages (vm.nr_hugepages), ";
+		}
+
+		// one more huge page to align the start, the head and tail are given back
+		void* base = mmap(nullptr, map_bytes + LUT_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (base == MAP_FAILED) return nullptr;
+
+		const uintptr_t beg = reinterpret_cast<uintptr_t>(base);
+		const uintptr_t aligned = (beg + LUT_HUGE_PAGE_SIZE - 1) / LUT_HUGE_PAGE_SIZE * LUT_HUGE_PAGE_SIZE;
+		const size_t head = aligned - beg;
+		char* addr = static_cast<char*>(base) + head;
+		if (head > 0) munmap(base, head);
+		if (head < LUT_HUGE_PAGE_SIZE) munmap(addr + map_bytes, LUT_HUGE_PAGE_SIZE - head);
+
+		if (pages == LUT_PAGES_TRANSPARENT && madvise(addr, map_bytes, MADV_HUGEPAGE) == 0)
+			used += "transparent huge pages";
+		else if (pages == LUT_PAGES_TRANSPARENT)
+			used += "4K pages, transparent huge pages are disabled";
+		else
+			used += "4K pages";
+		return addr;
+	}
+
+	size_t lut_elem_bytes(uint32_t data_type)
+	{
+		return data_type == LUT_FLOAT32 ? sizeof(float) : sizeof(uint16_t);
+	}
+
+	uint32_t float_bits(float val)
+	{
+		uint32_t bits;
+		memcpy(&bits, &val, sizeof(bits));
+		return bits;
+	}
+
+	float bits_float(uint32_t bits)
+	{
+		float val;
+		memcpy(&val, &bits, sizeof(val));
+		return val;
+	}
+
+	// IEEE half, round to nearest even
+	uint16_t float_to_half(float val)
+	{
+		const uint32_t bits = float_bits(val);
+		const uint32_t sign = (bits >> 16) & 0x8000;
+		uint32_t mant = bits & 0x7fffff;
+		const int exp = static_cast<int>((bits >> 23) & 0xff);
+
+		if (exp == 0xff) return static_cast<uint16_t>(sign | 0x7c00 | (mant != 0 ? 0x200 : 0));
+
+		const int e = exp - 127 + 15;
+		if (e >= 31) return static_cast<uint16_t>(sign | 0x7c00);
+		if (e <= 0)
+		{
+			// subnormal half
+			if (e < -10) return static_cast<uint16_t>(sign);
+			mant |= 0x800000;
+			const int shift = 14 - e;
+			uint32_t half = mant >> shift;
+			const uint32_t rem = mant & ((1u << shift) - 1);
+			const uint32_t mid = 1u << (shift - 1);
+			if (rem > mid || (rem == mid && (half & 1))) half++;
+			return static_cast<uint16_t>(sign | half);
+		}
+
+		uint32_t half = (static_cast<uint32_t>(e) << 10) | (mant >> 13);
+		const uint32_t rem = mant & 0x1fff;
+		if (rem > 0x1000 || (rem == 0x1000 && (half & 1))) half++;
+		return static_cast<uint16_t>(sign | half);
+	}
+
+	inline float half_to_float(uint16_t half)
+	{
+		const uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+		uint32_t exp = (half >> 10) & 0x1f;
+		uint32_t mant = half & 0x3ff;
+
+		if (exp == 0)
+		{
+			if (mant == 0) return bits_float(sign);
+			// subnormal half -> normal float
+			exp = 127 - 15 + 1;
+			while ((mant & 0x400) == 0)
+			{
+				mant <<= 1;
+				exp--;
+			}
+			return bits_float(sign | (exp << 23) | ((mant & 0x3ff) << 13));
+		}
+		if (exp == 0x1f) return bits_float(sign | 0x7f800000 | (mant << 13));
+		return bits_float(sign | ((exp + 127 - 15) << 23) | (mant << 13));
+	}
+
+	// bfloat16, round to nearest even
+	uint16_t float_to_bfloat(float val)
+	{
+		const uint32_t bits = float_bits(val);
+		if ((bits & 0x7fffffff) > 0x7f800000) return static_cast<uint16_t>((bits >> 16) | 0x40);
+		return static_cast<uint16_t>((bits + 0x7fff + ((bits >> 16) & 1)) >> 16);
+	}
+
+	inline float bfloat_to_float(uint16_t val)
+	{
+		return bits_float(static_cast<uint32_t>(val) << 16);
+	}
+
+	// scale and offset mapping [vmin, vmax] to [-32767, 32767]
+	void int16_scale(float vmin, float vmax, float& scale, float& offset)
+	{
+		offset = vmin / 2 + vmax / 2;
+		scale = (vmax - vmin) / 65534.0f;
+	}
+
+	int16_t float_to_int16(float val, float scale, float offset)
+	{
+		if (scale == 0) return 0;
+		const float ival = std::nearbyint((val - offset) / scale);
+		return static_cast<int16_t>(std::max(-32767.0f, std::min(32767.0f, ival)));
+	}
+
+	// encode n floats to the data type of the LUT file
+	void encode_values(const float* src, size_t n, uint32_t data_type, float scale, float offset, char* dst)
+	{
+		switch (data_type)
+		{
+		case LUT_FLOAT32:
+			memcpy(dst, src, n * sizeof(float));
+			break;
+		case LUT_FLOAT16:
+			for (size_t ii = 0; ii < n; ii++)
+			{
+				const uint16_t val = float_to_half(src[ii]);
+				memcpy(dst + ii * sizeof(val), &val, sizeof(val));
+			}
+			break;
+		case LUT_BFLOAT16:
+			for (size_t ii = 0; ii < n; ii++)
+			{
+				const uint16_t val = float_to_bfloat(src[ii]);
+				memcpy(dst + ii * sizeof(val), &val, sizeof(val));
+			}
+			break;
+		default:
+			for (size_t ii = 0; ii < n; ii++)
+			{
+				const int16_t val = float_to_int16(src[ii], scale, offset);
+				memcpy(dst + ii * sizeof(val), &val, sizeof(val));
+			}
+			break;
+		}
+	}
+
+	// temporary file the LUT file is written to before it is renamed into place, unique per process
+	// so that processes converting the same LUT at once never write into each other's file
+	std::string lut_tmp_file(const std::string& lut_file)
+	{
+		return lut_file + "." + std::to_string(getpid()) + ".tmp";
+	}
+
+	// write a binary LUT: the header, the axis values, the quantity names, the scale and offset of each
+	// quantity and the blocks; fill_block(ib, block) gives the float values of block ib, quantity by quantity,
+	// 1 if they cannot be read.
+	// The row strides, the data offset and size of the header are set here.
+	int write_lut_blocks(LutFileHeader& header, const std::vector<arma::fvec>& axes,
+		const std::vector<float>& scale, const std::vector<float>& offset,
+		const std::function<int(uint64_t, float*)>& fill_block, const std::string& bin_file)
+	{
+		using namespace std;
+		namespace fs = std::filesystem;
+
+		memcpy(header.magic, LUT_MAGIC, sizeof(LUT_MAGIC));
+		header.version = LUT_VERSION;
+
+		uint64_t nnodes = 1;
+		uint64_t stride = header.block_rows;
+		for (int ia = LUT_AXIS_NUM - 1; ia >= 0; ia--)
+		{
+			header.axis_len[ia] = static_cast<uint32_t>(axes[ia].n_elem);
+			header.row_stride[ia] = stride;
+			stride *= axes[ia].n_elem;
+			nnodes *= axes[ia].n_elem;
+		}
+
+		const size_t ncols = header.n_cols;
+		const size_t block_rows = header.block_rows;
+		const size_t elem_bytes = lut_elem_bytes(header.data_type);
+
+		size_t meta_bytes = sizeof(LutFileHeader) + ncols * LUT_COL_NAME_LEN + 2 * ncols * sizeof(float);
+		for (const auto& axis : axes)
+			meta_bytes += axis.n_elem * sizeof(float);
+
+		header.data_offset = align_page(meta_bytes);
+		header.data_bytes = header.n_rows * ncols * elem_bytes;
+
+		// write to a temporary file first, so a concurrent reader never maps a half-written LUT
+		const string tmp_file = lut_tmp_file(bin_file);
+		ofstream fid(tmp_file, ios::binary);
+		if (!fid.good())
+		{
+			cout << "Cannot create LUT file: " << tmp_file << endl;
+			return 1;
+		}
+
+		fid.write(reinterpret_cast<const char*>(&header), sizeof(LutFileHeader));
+		for (const auto& axis : axes)
+			fid.write(reinterpret_cast<const char*>(axis.memptr()), axis.n_elem * sizeof(float));
+		for (size_t q = 0; q < ncols; q++)
+		{
+			char name[LUT_COL_NAME_LEN] = {};
+			const string col = LUT_QUANTITIES[q].name;
+			memcpy(name, col.c_str(), min(col.length(), LUT_COL_NAME_LEN - 1));
+			fid.write(name, LUT_COL_NAME_LEN);
+		}
+		for (size_t q = 0; q < ncols; q++)
+		{
+			fid.write(reinterpret_cast<const char*>(&scale[q]), sizeof(float));
+			fid.write(reinterpret_cast<const char*>(&offset[q]), sizeof(float));
+		}
+
+		const vector<char> padding(header.data_offset - meta_bytes, 0);
+		fid.write(padding.data(), padding.size());
+
+		// one block of all the quantities at a time
+		vector<float> block(ncols * block_rows);
+		vector<char> encoded(ncols * block_rows * elem_bytes);
+		for (uint64_t ib = 0; ib < nnodes; ib++)
+		{
+			if (fill_block(ib, block.data()) != 0)
+			{
+				cout << "Cannot read the LUT block " << ib << " for LUT file: " << bin_file << endl;
+				fid.close();
+				fs::remove(tmp_file);
+				return 1;
+			}
+			for (size_t q = 0; q < ncols; q++)
+			{
+				encode_values(block.data() + q * block_rows, block_rows, header.data_type, scale[q], offset[q],
+					encoded.data() + q * block_rows * elem_bytes);
+			}
+			fid.write(encoded.data(), encoded.size());
+		}
+		fid.close();
+
+		if (!fid.good())
+		{
+			cout << "Cannot write LUT file: " << tmp_file << endl;
+			fs::remove(tmp_file);
+			return 1;
+		}
+
+		error_code ec;
+		fs::rename(tmp_file, bin_file, ec);
+		if (ec)
+		{
+			cout << "Cannot rename " << tmp_file << " to " << bin_file << ": " << ec.message() << endl;
+			fs::remove(tmp_file, ec);
+			return 1;
+		}
+
+		return 0;
+	}
+
+	// bytes of the header and the axis values, quantity names, scale and offset behind it
+	size_t lut_meta_bytes(const LutFileHeader& header)
+	{
+		size_t nbytes = sizeof(LutFileHeader) + header.n_cols * (LUT_COL_NAME_LEN + 2 * sizeof(float));
+		for (int ia = 0; ia < LUT_AXIS_NUM; ia++)
+			nbytes += header.axis_len[ia] * sizeof(float);
+		return nbytes;
+	}
+
+	// a compressed unit is the data of one (SZA, VZA) node, the LOS and DEM blocks under it
+	size_t lut_unit_bytes(const LutFileHeader& header)
+	{
+		return header.row_stride[LUT_AXIS_VZA] * header.n_cols * lut_elem_bytes(header.data_type);
+	}
+
+	//-------------------------------------------------------------
+	// *.swlutz: [LutFileHeader][metadata as in *.swlut][file offset of each unit + end of file, uint64]
+	// [zstd frame of each unit]; data_offset and data_bytes of the header are those of the *.swlut file
+	int read_lut_index(int fd, LutFileHeader& header, size_t& meta_bytes,
+		std::vector<uint64_t>& unit_offset, size_t& unit_bytes)
+	{
+		struct stat st {};
+		if (fstat(fd, &st) != 0 || pread(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) return 1;
+		if (memcmp(header.magic, LUT_MAGIC_ZSTD, sizeof(LUT_MAGIC_ZSTD)) != 0 || header.data_type >= LUT_PRECISION_NUM) return 1;
+
+		meta_bytes = lut_meta_bytes(header);
+		unit_bytes = lut_unit_bytes(header);
+		const uint64_t nunits = static_cast<uint64_t>(header.axis_len[LUT_AXIS_SZA]) * header.axis_len[LUT_AXIS_VZA];
+		if (nunits == 0 || unit_bytes == 0 || nunits * unit_bytes != header.data_bytes || meta_bytes > header.data_offset) return 1;
+
+		unit_offset.assign(nunits + 1, 0);
+		const size_t index_bytes = unit_offset.size() * sizeof(uint64_t);
+		if (pread(fd, unit_offset.data(), index_bytes, meta_bytes) != static_cast<ssize_t>(index_bytes)) return 1;
+
+		if (unit_offset[0] != meta_bytes + index_bytes || unit_offset[nunits] != static_cast<uint64_t>(st.st_size)) return 1;
+		for (uint64_t iu = 0; iu < nunits; iu++)
+		{
+			if (unit_offset[iu + 1] <= unit_offset[iu]) return 1;
+		}
+		return 0;
+	}
+
+	int compress_lut_file(const std::string& bin_file, const std::string& z_file)
+	{
+		using namespace std;
+		namespace fs = std::filesystem;
+
+#ifdef SWDR_HAVE_ZSTD
+		const int fd = ::open(bin_file.c_str(), O_RDONLY);
+		struct stat st {};
+		if (fd < 0 || fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(LutFileHeader))
+		{
+			cout << "Cannot open LUT file: " << bin_file << endl;
+			if (fd >= 0) ::close(fd);
+			return 1;
+		}
+		const size_t nbytes = st.st_size;
+		void* addr = mmap(nullptr, nbytes, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (addr == MAP_FAILED)
+		{
+			cout << "[Error] cannot map the LUT file: " << bin_file << endl;
+			return 1;
+		}
+		const char* base = static_cast<const char*>(addr);
+
+		LutFileHeader header{};
+		memcpy(&header, base, sizeof(header));
+		const size_t meta_bytes = lut_meta_bytes(header);
+		const size_t unit_bytes = lut_unit_bytes(header);
+		const uint64_t nunits = static_cast<uint64_t>(header.axis_len[LUT_AXIS_SZA]) * header.axis_len[LUT_AXIS_VZA];
+		if (memcmp(header.magic, LUT_MAGIC, sizeof(LUT_MAGIC)) != 0 || header.data_type >= LUT_PRECISION_NUM
+			|| nunits * unit_bytes != header.data_bytes || header.data_offset + header.data_bytes > nbytes)
+		{
+			cout << "[Error] the LUT file is damaged: " << bin_file << endl;
+			munmap(addr, nbytes);
+			return 1;
+		}
+
+		// the units are compressed in parallel
+		vector<vector<char>> frames(nunits);
+		atomic<bool> failed(false);
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, nunits, 1),
+			[&](const tbb::blocked_range<size_t>& br)
+		{
+			for (size_t iu = br.begin(); iu != br.end(); iu++)
+			{
+				vector<char>& frame = frames[iu];
+				frame.resize(ZSTD_compressBound(unit_bytes));
+				const size_t ret = ZSTD_compress(frame.data(), frame.size(),
+					base + header.data_offset + iu * unit_bytes, unit_bytes, LUT_ZSTD_LEVEL);
+				if (ZSTD_isError(ret))
+					failed = true;
+				else
+					frame.resize(ret);
+			}
+		});
+
+		vector<uint64_t> unit_offset(nunits + 1);
+		unit_offset[0] = meta_bytes + unit_offset.size() * sizeof(uint64_t);
+		for (uint64_t iu = 0; iu < nunits; iu++)
+			unit_offset[iu + 1] = unit_offset[iu] + frames[iu].size();
+
+		const string tmp_file = lut_tmp_file(z_file);
+		ofstream fid(tmp_file, ios::binary);
+		if (!failed && fid.good())
+		{
+			memcpy(header.magic, LUT_MAGIC_ZSTD, sizeof(LUT_MAGIC_ZSTD));
+			fid.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			fid.write(base + sizeof(header), meta_bytes - sizeof(header));
+			fid.write(reinterpret_cast<const char*>(unit_offset.data()), unit_offset.size() * sizeof(uint64_t));
+			for (const auto& frame : frames)
+				fid.write(frame.data(), frame.size());
+			fid.close();
+		}
+		munmap(addr, nbytes);
+
+		if (failed || !fid.good())
+		{
+			cout << "Cannot write the compressed LUT file: " << tmp_file << endl;
+			fs::remove(tmp_file);
+			return 1;
+		}
+
+		error_code ec;
+		fs::rename(tmp_file, z_file, ec);
+		if (ec)
+		{
+			cout << "Cannot rename " << tmp_file << " to " << z_file << ": " << ec.message() << endl;
+			fs::remove(tmp_file, ec);
+			return 1;
+		}
+
+		cout << "Compressed " << header.data_bytes << " bytes of LUT data to "
+			<< unit_offset[nunits] - unit_offset[0] << " bytes in " << nunits << " units\n";
+		return 0;
+#else
+		cout << "[Error] the program is built without zstd, cannot compress " << bin_file << " to " << z_file << endl;
+		return 1;
+#endif
+	}
+}
+
+
+int parse_lut_precision(const std::string& name, LutPrecision& precision)
+{
+	for (int ip = 0; ip < LUT_PRECISION_NUM; ip++)
+	{
+		if (name == LUT_PRECISION_NAMES[ip])
+		{
+			precision = static_cast<LutPrecision>(ip);
+			return 0;
+		}
+	}
+
+	std::cout << "[Error] unknown LUT precision: " << name << ", use float32, float16, bfloat16 or int16.\n";
+	return 1;
+}
+
+const char* lut_precision_name(LutPrecision precision)
+{
+	return precision < LUT_PRECISION_NUM ? LUT_PRECISION_NAMES[precision] : "unknown";
+}
+
+
+LutStore::LutStore() : m_map(nullptr), m_map_bytes(0), m_huge_pages(LUT_PAGES_DEFAULT), m_numa(LUT_NUMA_DEFAULT),
+	m_lut_fd(-1), m_unit_bytes(0), m_header{}, m_data(nullptr), m_elem_bytes(sizeof(float))
+{
+}
+
+LutStore::~LutStore()
+{
+	unmap();
+}
+
+void LutStore::prefetch(arma::uword first_row, arma::uword nrows) const
+{
+	if (m_data == nullptr || nrows == 0) return;
+	if (m_unit_bytes > 0)
+	{
+		ensure_rows(first_row, nrows);
+		return;
+	}
+
+	const arma::uword block_rows = m_header.block_rows;
+	const size_t block_bytes = static_cast<size_t>(m_header.n_cols) * block_rows * m_elem_bytes;
+	const arma::uword first_block = first_row / block_rows;
+	const arma::uword last_block = (first_row + nrows - 1) / block_rows;
+
+	// madvise needs a page aligned start
+	const char* base = static_cast<const char*>(m_map);
+	const size_t beg = m_header.data_offset + first_block * block_bytes;
+	const size_t end = std::min(m_map_bytes, m_header.data_offset + (last_block + 1) * block_bytes);
+	const size_t beg_page = beg / LUT_PAGE_SIZE * LUT_PAGE_SIZE;
+
+	madvise(const_cast<char*>(base) + beg_page, end - beg_page, MADV_WILLNEED);
+}
+
+void LutStore::decode_block(arma::uword block, arma::uword q, float* out) const
+{
+	const arma::uword block_rows = m_header.block_rows;
+	const char* src = quantity_data(block, q);
+
+	switch (m_header.data_type)
+	{
+	case LUT_FLOAT32:
+		memcpy(out, src, block_rows * sizeof(float));
+		break;
+	case LUT_FLOAT16:
+	{
+		const uint16_t* val = reinterpret_cast<const uint16_t*>(src);
+		for (arma::uword ir = 0; ir < block_rows; ir++)
+			out[ir] = half_to_float(val[ir]);
+		break;
+	}
+	case LUT_BFLOAT16:
+	{
+		const uint16_t* val = reinterpret_cast<const uint16_t*>(src);
+		for (arma::uword ir = 0; ir < block_rows; ir++)
+			out[ir] = bfloat_to_float(val[ir]);
+		break;
+	}
+	default:
+	{
+		const int16_t* val = reinterpret_cast<const int16_t*>(src);
+		const float scale = m_scale[q];
+		const float offset = m_offset[q];
+		for (arma::uword ir = 0; ir < block_rows; ir++)
+			out[ir] = offset + scale * val[ir];
+		break;
+	}
+	}
+}
+
+int LutStore::copy_rows(arma::uword first_row, arma::uword nrows, arma::fmat& dst, arma::uword dst_row) const
+{
+	const arma::uword block_rows = m_header.block_rows;
+	const arma::uword first_block = first_row / block_rows;
+	const arma::uword nblocks = nrows / block_rows;
+	if (ensure_rows(first_row, nrows) != 0) return 1;
+
+	for (arma::uword ib = 0; ib < nblocks; ib++)
+	{
+		for (arma::uword q = 0; q < m_header.n_cols; q++)
+			decode_block(first_block + ib, q, dst.colptr(q) + dst_row + ib * block_rows);
+	}
+	return 0;
+}
+
+int LutStore::open(const myConfig& cfg, int numa_node)
+{
+	using namespace std;
+	namespace fs = std::filesystem;
+
+	const string& lut_file = cfg.lut_file;
+	if (lut_file.length() == 0)
+	{
+		cout << "Please specify LUT file\n";
+		return 1;
+	}
+
+	LutPrecision precision = LUT_FLOAT32;
+	if (parse_lut_precision(cfg.lut_precision, precision) != 0) return 1;
+
+	const int huge_pages = find_name(cfg.lut_huge_pages, LUT_HUGE_PAGES_NAMES, LUT_PAGES_NUM);
+	const int numa = find_name(cfg.lut_numa, LUT_NUMA_NAMES, LUT_NUMA_NUM);
+	if (huge_pages < 0 || numa < 0)
+	{
+		cout << "[Error] unknown LUT placement: lut_huge_pages = " << cfg.lut_huge_pages
+			<< ", lut_numa = " << cfg.lut_numa << endl;
+		return 1;
+	}
+	m_huge_pages = static_cast<LutHugePages>(huge_pages);
+	m_numa = static_cast<LutNuma>(numa);
+
+	// one binary LUT file per precision: *.swlut for float32, *.float16.swlut, ...,
+	// *.swlutz instead of *.swlut for lut_compression = zstd
+	const fs::path mypath{ lut_file };
+	const bool direct = mypath.extension() == ".swlut" || mypath.extension() == ".swlutz";
+	const bool compressed = direct ? mypath.extension() == ".swlutz" : cfg.lut_compression == "zstd";
+	fs::path bin_file = mypath;
+	if (!direct)
+	{
+		string suffix = ".swlut";
+		if (precision != LUT_FLOAT32) suffix = string(".") + lut_precision_name(precision) + suffix;
+		bin_file = mypath.parent_path() / (mypath.stem().u8string() + suffix);
+	}
+	fs::path lut_bin_file = bin_file;
+	if (compressed && !direct) lut_bin_file.replace_extension(".swlutz");
+
+#ifndef SWDR_HAVE_ZSTD
+	if (compressed)
+	{
+		cout << "[Error] the program is built without zstd, a compressed LUT cannot be read: "
+			<< lut_bin_file.u8string() << endl;
+		return 1;
+	}
+#endif
+	if (compressed && cfg.lut_shm_name.length() > 0)
+	{
+		cout << "[Error] a compressed LUT cannot be shared with lut_shm_name, use lut_compression = none.\n";
+		return 1;
+	}
+
+	// rebuild the binary LUT written by an older version
+	if (fs::exists(lut_bin_file) && !direct && fs::exists(mypath)
+		&& lut_file_version(lut_bin_file.u8string()) != LUT_VERSION)
+	{
+		cout << "The binary LUT file is out of date, rebuild it: " << lut_bin_file.u8string() << endl;
+		fs::remove(lut_bin_file);
+	}
+
+	if (!fs::exists(lut_bin_file))
+	{
+		if (!fs::exists(mypath))
+		{
+			cout << "[Error] cannot find the LUT file: " << lut_file << endl;
+			return 1;
+		}
+
+		// a compressed LUT is built from the uncompressed one, which is removed afterwards
+		const bool keep_bin = fs::exists(bin_file) && lut_file_version(bin_file.u8string()) == LUT_VERSION;
+		if (!keep_bin)
+		{
+			// old armadillo binary sidecar, or the text LUT itself
+			const fs::path arma_bin_file = mypath.parent_path() / (mypath.stem().u8string() + ".bin");
+
+			arma::fmat lut;
+			if (fs::exists(arma_bin_file))
+			{
+				cout << "Convert LUT from " << arma_bin_file.u8string() << endl;
+				if (!lut.load(arma_bin_file.u8string()))
+				{
+					cout << "[Error] cannot load the LUT file: " << arma_bin_file.u8string() << endl;
+					return 1;
+				}
+			}
+			else
+			{
+				if (read_text_lut(lut_file, LUT_TEXT_COLS, lut) != 0) return 1;
+			}
+
+			if (write_lut_bin(lut, cfg, bin_file.u8string()) != 0) return 1;
+			cout << "Save the LUT file to the binary file: " << bin_file << endl;
+		}
+
+		if (compressed)
+		{
+			if (compress_lut_file(bin_file.u8string(), lut_bin_file.u8string()) != 0) return 1;
+			cout << "Save the LUT file to the compressed file: " << lut_bin_file << endl;
+			if (!keep_bin) fs::remove(bin_file);
+		}
+	}
+
+	if (compressed)
+	{
+		cout << "Read compressed LUT blocks on demand from " << lut_bin_file.u8string() << endl;
+		if (open_compressed(lut_bin_file.u8string(), numa_node) != 0) return 1;
+	}
+	else if (cfg.lut_shm_name.length() > 0)
+	{
+		if (attach_shm(cfg.lut_shm_name, bin_file.u8string()) != 0) return 1;
+	}
+	else
+	{
+		cout << "Map LUT directly from " << bin_file.u8string() << endl;
+		if (map_file(bin_file.u8string()) != 0) return 1;
+
+		// huge pages and NUMA placement need a private copy in anonymous memory
+		if (m_huge_pages != LUT_PAGES_DEFAULT || m_numa != LUT_NUMA_DEFAULT)
+		{
+			if (make_resident(numa_node, bin_file.u8string()) != 0) return 1;
+		}
+	}
+	cout << "LUT placement: " << m_placement << endl;
+
+	//-------------------------------------------------------------
+	// the retrieval indexes the LUT by the axis lists of the config file
+	if (m_header.n_cols != LUT_Q_NUM)
+	{
+		cout << "[Error] the LUT has " << m_header.n_cols << " quantities, "
+			<< LUT_Q_NUM << " are expected.\n";
+		return 1;
+	}
+
+	if (!direct && m_header.data_type != static_cast<uint32_t>(precision))
+	{
+		cout << "[Error] the LUT file is stored as " << lut_precision_name(this->precision())
+			<< ", " << lut_precision_name(precision) << " is expected: " << lut_bin_file.u8string() << endl;
+		return 1;
+	}
+
+	// a binary LUT given directly, e.g. a subset of swdr_lut_subset, carries its own axes
+	if (direct) return 0;
+
+	const vector<arma::fvec> axes = config_axes(cfg);
+	for (int ia = 0; ia < LUT_AXIS_NUM; ia++)
+	{
+		const bool same = axes[ia].n_elem == m_axes[ia].n_elem
+			&& arma::approx_equal(axes[ia], m_axes[ia], "absdiff", 1e-4);
+		if (!same)
+		{
+			cout << "[Error] the " << axis_name(ia) << " list of the config file does not match the LUT file: "
+				<< lut_bin_file.u8string() << endl;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int LutStore::map_file(const std::string& bin_file)
+{
+	using namespace std;
+
+	unmap();
+
+	const int fd = ::open(bin_file.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		cout << "Cannot open LUT file: " << bin_file << endl;
+		return 1;
+	}
+
+	struct stat st {};
+	if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(LutFileHeader))
+	{
+		cout << "[Error] the LUT file is too small: " << bin_file << endl;
+		::close(fd);
+		return 1;
+	}
+
+	const size_t nbytes = st.st_size;
+	void* addr = mmap(nullptr, nbytes, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (addr == MAP_FAILED)
+	{
+		cout << "[Error] cannot map the LUT file: " << bin_file << endl;
+		return 1;
+	}
+
+	m_map = addr;
+	m_map_bytes = nbytes;
+	m_placement = "mapped file, 4K pages of the page cache";
+
+	return parse_map(bin_file);
+}
+
+void* LutStore::alloc_resident(size_t nbytes, int numa_node, size_t& map_bytes)
+{
+	using namespace std;
+
+	string pages;
+	void* addr = map_anonymous(nbytes, m_huge_pages, map_bytes, pages);
+	if (addr == nullptr)
+	{
+		cout << "[Error] cannot allocate " << nbytes << " bytes for the LUT: " << strerror(errno) << endl;
+		return nullptr;
+	}
+
+	// the policy is set before the pages are touched
+	string numa = "first touch";
+	const vector<int> nodes = numa_nodes();
+	if (m_numa == LUT_NUMA_INTERLEAVE)
+	{
+		if (nodes.size() < 2)
+			numa = "first touch, single NUMA node";
+		else if (set_numa_policy(addr, map_bytes, MPOL_INTERLEAVE, nodes) == 0)
+			numa = "interleaved over " + to_string(nodes.size()) + " NUMA nodes";
+		else
+			numa = string("first touch, interleave failed: ") + strerror(errno);
+	}
+	else if (m_numa == LUT_NUMA_REPLICATE)
+	{
+		const int node = numa_node >= 0 ? numa_node : current_numa_node();
+		if (set_numa_policy(addr, map_bytes, MPOL_BIND, { node }) == 0)
+			numa = "copy on NUMA node " + to_string(node);
+		else
+			numa = "first touch, binding to NUMA node " + to_string(node) + " failed: " + strerror(errno);
+	}
+
+	m_placement = "resident copy, " + pages + ", " + numa;
+	return addr;
+}
+
+int LutStore::make_resident(int numa_node, const std::string& source)
+{
+	size_t map_bytes = 0;
+	void* addr = alloc_resident(m_map_bytes, numa_node, map_bytes);
+	if (addr == nullptr) return 1;
+
+	memcpy(addr, m_map, m_map_bytes);
+	mprotect(addr, map_bytes, PROT_READ);
+
+	const std::string placement = m_placement;
+	unmap();
+	m_map = addr;
+	m_map_bytes = map_bytes;
+	m_placement = placement;
+
+	return parse_map(source);
+}
+
+//-------------------------------------------------------------
+// A compressed LUT is rebuilt in anonymous memory as the image of the *.swlut file: the header
+// and the metadata are read at once, the (SZA, VZA) units of the data section when they are used.
+int LutStore::open_compressed(const std::string& z_file, int numa_node)
+{
+	using namespace std;
+
+	unmap();
+
+	const int fd = ::open(z_file.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		cout << "Cannot open LUT file: " << z_file << endl;
+		return 1;
+	}
+
+	LutFileHeader header{};
+	size_t meta_bytes = 0;
+	vector<uint64_t> unit_offset;
+	size_t unit_bytes = 0;
+	if (read_lut_index(fd, header, meta_bytes, unit_offset, unit_bytes) != 0)
+	{
+		cout << "[Error] the compressed LUT file is damaged: " << z_file << endl;
+		::close(fd);
+		return 1;
+	}
+	if (header.version != LUT_VERSION)
+	{
+		cout << "[Error] LUT file version " << header.version << " is not supported (expected "
+			<< LUT_VERSION << "): " << z_file << endl;
+		cout << "Remove it to rebuild from the text LUT.\n";
+		::close(fd);
+		return 1;
+	}
+
+	size_t map_bytes = 0;
+	void* addr = alloc_resident(header.data_offset + header.data_bytes, numa_node, map_bytes);
+	if (addr == nullptr)
+	{
+		::close(fd);
+		return 1;
+	}
+
+	// the metadata as in the *.swlut file, the data pages stay untouched until they are decompressed
+	if (pread(fd, addr, meta_bytes, 0) != static_cast<ssize_t>(meta_bytes))
+	{
+		cout << "[Error] cannot read the LUT file: " << z_file << endl;
+		munmap(addr, map_bytes);
+		::close(fd);
+		return 1;
+	}
+	memcpy(addr, LUT_MAGIC, sizeof(LUT_MAGIC));
+
+	m_map = addr;
+	m_map_bytes = map_bytes;
+	m_placement = "zstd units decompressed on demand into a " + m_placement;
+	m_lut_fd = fd;
+	m_unit_offset = unit_offset;
+	m_unit_bytes = unit_bytes;
+	m_unit_once.reset(new once_flag[unit_offset.size() - 1]);
+	m_unit_ok.assign(unit_offset.size() - 1, 0);
+
+	return parse_map(z_file);
+}
+
+void LutStore::load_unit(arma::uword iu) const
+{
+	std::call_once(m_unit_once[iu], [this, iu]() { m_unit_ok[iu] = decompress_unit(iu) == 0; });
+}
+
+int LutStore::decompress_unit(arma::uword iu) const
+{
+	using namespace std;
+
+	const size_t nbytes = m_unit_offset[iu + 1] - m_unit_offset[iu];
+	vector<char> buffer(nbytes);
+	size_t pos = 0;
+	while (pos < nbytes)
+	{
+		const ssize_t nread = pread(m_lut_fd, buffer.data() + pos, nbytes - pos, m_unit_offset[iu] + pos);
+		if (nread <= 0)
+		{
+			if (nread < 0 && errno == EINTR) continue;
+			cout << "[Error] cannot read the LUT unit " << iu << " of the compressed LUT\n";
+			return 1;
+		}
+		pos += nread;
+	}
+
+	char* dst = static_cast<char*>(m_map) + m_header.data_offset + iu * m_unit_bytes;
+#ifdef SWDR_HAVE_ZSTD
+	const size_t ret = ZSTD_decompress(dst, m_unit_bytes, buffer.data(), nbytes);
+	if (ZSTD_isError(ret) || ret != m_unit_bytes)
+	{
+		cout << "[Error] cannot decompress the LUT unit " << iu << ": "
+			<< (ZSTD_isError(ret) ? ZSTD_getErrorName(ret) : "wrong size") << endl;
+		return 1;
+	}
+	return 0;
+#else
+	(void)dst;
+	return 1;
+#endif
+}
+
+int LutStore::ensure_rows(arma::uword first_row, arma::uword nrows) const
+{
+	if (m_unit_bytes == 0 || nrows == 0) return 0;
+
+	// a unit that failed stays zero filled, its rows must not be used
+	const arma::uword unit_rows = m_header.row_stride[LUT_AXIS_VZA];
+	for (arma::uword iu = first_row / unit_rows; iu <= (first_row + nrows - 1) / unit_rows; iu++)
+	{
+		load_unit(iu);
+		if (!m_unit_ok[iu]) return 1;
+	}
+	return 0;
+}
+
+int LutStore::prefetch_rows(const arma::uvec& first_rows, arma::uword nrows) const
+{
+	if (m_unit_bytes == 0)
+	{
+		for (const auto& row : first_rows)
+			prefetch(row, nrows);
+		return 0;
+	}
+
+	// the units of all the ranges, decompressed in parallel
+	const arma::uword unit_rows = m_header.row_stride[LUT_AXIS_VZA];
+	std::vector<arma::uword> units;
+	for (const auto& row : first_rows)
+	{
+		for (arma::uword iu = row / unit_rows; nrows > 0 && iu <= (row + nrows - 1) / unit_rows; iu++)
+			units.push_back(iu);
+	}
+	std::sort(units.begin(), units.end());
+	units.erase(std::unique(units.begin(), units.end()), units.end());
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, units.size(), 1),
+		[&](const tbb::blocked_range<size_t>& br)
+	{
+		for (size_t ii = br.begin(); ii != br.end(); ii++)
+			load_unit(units[ii]);
+	});
+
+	for (const auto& iu : units)
+	{
+		if (!m_unit_ok[iu]) return 1;
+	}
+	return 0;
+}
+
+//-------------------------------------------------------------
+// The first process of a node copies the binary LUT into the shared memory segment,
+// the following ones map the segment read-only. The magic is written last,
+// so a segment with a valid magic is always complete. The stamp of the LUT file behind the copy
+// rejects a segment published from an older version of the file.
+int LutStore::attach_shm(const std::string& shm_name, const std::string& bin_file)
+{
+	using namespace std;
+
+	unmap();
+
+	const string name = shm_name[0] == '/' ? shm_name : "/" + shm_name;
+
+	struct stat st_file {};
+	if (stat(bin_file.c_str(), &st_file) != 0)
+	{
+		cout << "[Error] cannot find the LUT file: " << bin_file << endl;
+		return 1;
+	}
+	const size_t file_bytes = st_file.st_size;
+	const size_t nbytes = file_bytes + sizeof(LutShmStamp);
+
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd < 0 && errno == ENOENT)
+	{
+		const int fd_new = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+		if (fd_new >= 0) return publish_shm(fd_new, name, bin_file);
+
+		// another process has just created it
+		if (errno == EEXIST) fd = shm_open(name.c_str(), O_RDONLY, 0);
+	}
+	if (fd < 0)
+	{
+		cout << "[Error] cannot open the shared memory LUT " << name << ": " << strerror(errno) << endl;
+		return 1;
+	}
+
+	// wait until the publisher has sized the segment
+	struct stat st {};
+	for (int iw = 0; iw < LUT_SHM_WAIT_SECONDS * 10; iw++)
+	{
+		if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) >= nbytes) break;
+		this_thread::sleep_for(chrono::milliseconds(100));
+	}
+	if (static_cast<size_t>(st.st_size) != nbytes)
+	{
+		cout << "[Error] the shared memory LUT " << name << " does not match the LUT file: " << bin_file << endl;
+		cout << "Remove /dev/shm" << name << " if the LUT file has been changed.\n";
+		::close(fd);
+		return 1;
+	}
+
+	void* addr = mmap(nullptr, nbytes, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (addr == MAP_FAILED)
+	{
+		cout << "[Error] cannot map the shared memory LUT: " << name << endl;
+		return 1;
+	}
+	m_map = addr;
+	m_map_bytes = nbytes;
+
+	// wait until the publisher has copied the whole LUT
+	const volatile char* magic = static_cast<const volatile char*>(m_map);
+	for (int iw = 0; iw < LUT_SHM_WAIT_SECONDS * 10 && magic[0] != LUT_MAGIC[0]; iw++)
+		this_thread::sleep_for(chrono::milliseconds(100));
+	atomic_thread_fence(memory_order_acquire);
+	if (magic[0] != LUT_MAGIC[0])
+	{
+		cout << "[Error] the shared memory LUT " << name << " has not been completed by the process publishing it\n";
+		cout << "Remove /dev/shm" << name << " if that process has stopped.\n";
+		unmap();
+		return 1;
+	}
+
+	const LutShmStamp stamp = lut_shm_stamp(st_file);
+	if (memcmp(static_cast<const char*>(m_map) + file_bytes, &stamp, sizeof(stamp)) != 0)
+	{
+		cout << "[Error] the shared memory LUT " << name << " does not match the LUT file: " << bin_file << endl;
+		cout << "Remove /dev/shm" << name << " if the LUT file has been changed.\n";
+		unmap();
+		return 1;
+	}
+
+	cout << "Attach LUT from shared memory " << name << endl;
+	m_placement = "shared memory " + name + ", pages placed by the publishing process";
+	return parse_map(name);
+}
+
+int LutStore::publish_shm(int fd, const std::string& shm_name, const std::string& bin_file)
+{
+	using namespace std;
+
+	cout << "Publish LUT " << bin_file << " to shared memory " << shm_name << endl;
+
+	struct stat st {};
+	const int fd_file = ::open(bin_file.c_str(), O_RDONLY);
+	if (fd_file < 0 || fstat(fd_file, &st) != 0)
+	{
+		cout << "Cannot open LUT file: " << bin_file << endl;
+		if (fd_file >= 0) ::close(fd_file);
+		::close(fd);
+		shm_unlink(shm_name.c_str());
+		return 1;
+	}
+
+	// the LUT file and its stamp behind it
+	const size_t file_bytes = st.st_size;
+	const size_t nbytes = file_bytes + sizeof(LutShmStamp);
+	void* addr = MAP_FAILED;
+	if (ftruncate(fd, nbytes) == 0)
+		addr = mmap(nullptr, nbytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+
+	// the magic stays zero until the whole LUT is copied
+	bool ok = addr != MAP_FAILED && file_bytes >= sizeof(LutFileHeader);
+
+	// the placement is set before the pages are touched by the copy; tmpfs has no explicit
+	// huge pages and one segment serves all the nodes, so replicate falls back to interleave
+	string pages = "4K pages";
+	if (ok && m_huge_pages != LUT_PAGES_DEFAULT)
+	{
+		pages = madvise(addr, nbytes, MADV_HUGEPAGE) == 0 ? "transparent huge pages (shmem_enabled)"
+			: "4K pages, transparent huge pages are disabled";
+	}
+	string numa = "first touch";
+	const vector<int> nodes = numa_nodes();
+	if (ok && m_numa != LUT_NUMA_DEFAULT && nodes.size() > 1)
+	{
+		numa = set_numa_policy(addr, nbytes, MPOL_INTERLEAVE, nodes) == 0
+			? "interleaved over " + to_string(nodes.size()) + " NUMA nodes" : "first touch, interleave failed";
+	}
+	m_placement = "shared memory " + shm_name + ", " + pages + ", " + numa;
+	size_t pos = sizeof(LUT_MAGIC);
+	while (ok && pos < file_bytes)
+	{
+		const ssize_t nread = pread(fd_file, static_cast<char*>(addr) + pos, file_bytes - pos, pos);
+		if (nread <= 0)
+		{
+			if (nread < 0 && errno == EINTR) continue;
+			ok = false;
+			break;
+		}
+		pos += nread;
+	}
+	char magic[sizeof(LUT_MAGIC)] = {};
+	ok = ok && pread(fd_file, magic, sizeof(magic), 0) == static_cast<ssize_t>(sizeof(magic));
+	::close(fd_file);
+
+	if (!ok)
+	{
+		cout << "[Error] cannot copy the LUT file to shared memory " << shm_name << ": " << strerror(errno) << endl;
+		if (addr != MAP_FAILED) munmap(addr, nbytes);
+		shm_unlink(shm_name.c_str());
+		return 1;
+	}
+
+	const LutShmStamp stamp = lut_shm_stamp(st);
+	memcpy(static_cast<char*>(addr) + file_bytes, &stamp, sizeof(stamp));
+
+	// mark the segment as ready, the first magic byte is checked by the readers
+	memcpy(static_cast<char*>(addr) + 1, magic + 1, sizeof(magic) - 1);
+	atomic_thread_fence(memory_order_release);
+	static_cast<volatile char*>(addr)[0] = magic[0];
+
+	m_map = addr;
+	m_map_bytes = nbytes;
+
+	return parse_map(shm_name);
+}
+
+int LutStore::parse_map(const std::string& source)
+{
+	using namespace std;
+
+	const size_t nbytes = m_map_bytes;
+	const char* base = static_cast<const char*>(m_map);
+	memcpy(&m_header, base, sizeof(LutFileHeader));
+
+	if (memcmp(m_header.magic, LUT_MAGIC, sizeof(LUT_MAGIC)) != 0)
+	{
+		cout << "[Error] not a binary LUT file: " << source << endl;
+		unmap();
+		return 1;
+	}
+	if (m_header.version != LUT_VERSION)
+	{
+		cout << "[Error] LUT file version " << m_header.version << " is not supported (expected "
+			<< LUT_VERSION << "): " << source << endl;
+		cout << "Remove it to rebuild from the text LUT.\n";
+		unmap();
+		return 1;
+	}
+
+	// axis grids and column schema follow the fixed header
+	size_t pos = sizeof(LutFileHeader);
+	uint64_t nnodes = 1;
+	m_axes.assign(LUT_AXIS_NUM, arma::fvec());
+	for (int ia = 0; ia < LUT_AXIS_NUM; ia++)
+	{
+		const size_t len = m_header.axis_len[ia];
+		if (pos + len * sizeof(float) > nbytes) break;
+
+		m_axes[ia] = arma::fvec(len);
+		memcpy(m_axes[ia].memptr(), base + pos, len * sizeof(float));
+		pos += len * sizeof(float);
+		nnodes *= len;
+	}
+
+	const size_t ncols = m_header.n_cols;
+	m_col_names.clear();
+	for (size_t ic = 0; ic < ncols && pos + LUT_COL_NAME_LEN <= nbytes; ic++)
+	{
+		char name[LUT_COL_NAME_LEN + 1] = {};
+		memcpy(name, base + pos, LUT_COL_NAME_LEN);
+		m_col_names.emplace_back(name);
+		pos += LUT_COL_NAME_LEN;
+	}
+
+	// decoding of the int16 values
+	m_scale.assign(ncols, 1.0f);
+	m_offset.assign(ncols, 0.0f);
+	if (pos + 2 * ncols * sizeof(float) <= nbytes)
+	{
+		for (size_t ic = 0; ic < ncols; ic++)
+		{
+			memcpy(&m_scale[ic], base + pos, sizeof(float));
+			memcpy(&m_offset[ic], base + pos + sizeof(float), sizeof(float));
+			pos += 2 * sizeof(float);
+		}
+	}
+
+	m_elem_bytes = lut_elem_bytes(m_header.data_type);
+
+	const uint64_t nrows = m_header.n_rows;
+	bool valid = m_col_names.size() == ncols
+		&& m_header.data_type < LUT_PRECISION_NUM
+		&& pos <= m_header.data_offset
+		&& nnodes * m_header.block_rows == nrows
+		&& m_header.data_bytes == nrows * ncols * m_elem_bytes
+		&& m_header.data_offset + m_header.data_bytes <= nbytes
+		&& m_header.clear_row_st <= m_header.clear_row_ed && m_header.clear_row_ed < m_header.block_rows
+		&& m_header.n_cloudy_rows > 0 && m_header.n_cloudy_rows <= LUT_MAX_CLOUDY_ROWS;
+	for (uint32_t ir = 0; valid && ir < m_header.n_cloudy_rows; ir++)
+		valid = m_header.cloudy_rows[ir] < m_header.block_rows;
+	if (!valid)
+	{
+		cout << "[Error] the LUT file is damaged: " << source << endl;
+		unmap();
+		return 1;
+	}
+
+	m_data = base + m_header.data_offset;
+
+	// a scene only touches a few SZA/VZA nodes, no read-ahead of the rest of the LUT
+	madvise(m_map, m_map_bytes, MADV_RANDOM);
+	return 0;
+}
+
+void LutStore::unmap()
+{
+	if (m_map != nullptr)
+	{
+		munmap(m_map, m_map_bytes);
+	}
+	m_map = nullptr;
+	m_map_bytes = 0;
+	m_data = nullptr;
+
+	if (m_lut_fd >= 0) ::close(m_lut_fd);
+	m_lut_fd = -1;
+	m_unit_offset.clear();
+	m_unit_bytes = 0;
+	m_unit_once.reset();
+	m_unit_ok.clear();
+}
+
+void LutStore::print() const
+{
+	using namespace std;
+
+	cout << "LUT rows     : " << m_header.n_rows << endl;
+	cout << "LUT cols     : " << m_header.n_cols << endl;
+	cout << "Precision    : " << lut_precision_name(precision()) << endl;
+	cout << "Placement    : " << m_placement << endl;
+	cout << "Block rows   : " << m_header.block_rows << endl;
+	for (int ia = 0; ia < LUT_AXIS_NUM; ia++)
+	{
+		cout << axis_name(ia) << " nodes    : " << m_header.axis_len[ia]
+			<< " (stride " << m_header.row_stride[ia] << " rows)" << endl;
+	}
+	cout << "Clear rows   : " << m_header.clear_row_st << " - " << m_header.clear_row_ed << endl;
+	cout << "Cloudy rows  : ";
+	for (uint32_t ir = 0; ir < m_header.n_cloudy_rows; ir++)
+		cout << m_header.cloudy_rows[ir] << ", ";
+	cout << endl;
+}
+
+arma::uvec LutStore::cloudy_rows() const
+{
+	arma::uvec rows(m_header.n_cloudy_rows);
+	for (uint32_t ir = 0; ir < m_header.n_cloudy_rows; ir++)
+		rows(ir) = m_header.cloudy_rows[ir];
+	return rows;
+}
+
+
+int current_numa_node()
+{
+	unsigned int cpu = 0;
+	unsigned int node = 0;
+	if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) return 0;
+	return static_cast<int>(node);
+}
+
+int load_lut_store(const myConfig& cfg, std::shared_ptr<const LutStore>& lut)
+{
+	using namespace std;
+
+	cout << "Begin to read LUT file: " << cfg.lut_file << endl;
+
+	arma::wall_clock timer;
+	timer.tic();
+
+	auto store = make_shared<LutStore>();
+	if (store->open(cfg) != 0) return 1;
+	lut = store;
+
+	cout << "LUT file have been read in " << timer.toc() << " seconds.\n";
+	return 0;
+}
+
+int load_lut_replicas(const myConfig& cfg, std::vector<std::shared_ptr<const LutStore>>& luts)
+{
+	using namespace std;
+
+	luts.clear();
+	const vector<int> nodes = numa_nodes();
+	if (cfg.lut_numa != "replicate" || cfg.lut_shm_name.length() > 0 || nodes.size() < 2)
+	{
+		shared_ptr<const LutStore> lut;
+		if (load_lut_store(cfg, lut) != 0) return 1;
+		luts.push_back(lut);
+		return 0;
+	}
+
+	cout << "Begin to read LUT file: " << cfg.lut_file << " (one copy per NUMA node)\n";
+
+	arma::wall_clock timer;
+	timer.tic();
+
+	luts.assign(nodes.back() + 1, nullptr);
+	for (const int node : nodes)
+	{
+		auto store = make_shared<LutStore>();
+		if (store->open(cfg, node) != 0) return 1;
+		luts[node] = store;
+	}
+
+	// offline node ids share the copy of the first node
+	for (auto& lut : luts)
+	{
+		if (lut == nullptr) lut = luts[nodes[0]];
+	}
+
+	cout << "LUT file have been read in " << timer.toc() << " seconds.\n";
+	return 0;
+}
+
+
+int read_text_lut(const std::string& lut_file, arma::uword lut_cols, arma::fmat& lut)
+{
+	using namespace std;
+
+	const size_t ncols = lut_cols;
+
+	// the whole file in one buffer, the rows are parsed in place
+	ifstream fid{ lut_file, ios::binary };
+	if (fid.is_open() != 1)
+	{
+		cout << "Cannot open input file: " << lut_file << endl;
+		return 1;
+	}
+
+	fid.seekg(0, ios::end);
+	string text(static_cast<size_t>(fid.tellg()), '\0');
+	fid.seekg(0, ios::beg);
+	fid.read(&text[0], text.size());
+	if (!fid.good())
+	{
+		cout << "Cannot read input file: " << lut_file << endl;
+		return 1;
+	}
+	fid.close();
+
+	// Remove the headers and the empty lines at the end of file
+	const char* const head = text.c_str();
+	const char* beg = static_cast<const char*>(memchr(head, '\n', text.size()));
+	beg = beg == nullptr ? head + text.size() : beg + 1;
+	const char* end = head + text.size();
+	while (end > beg && is_lut_space(end[-1])) end--;
+
+	// chunks of whole lines, parsed by TBB
+	const size_t chunk_bytes = 4 << 20;
+	vector<const char*> chunks{ beg };
+	while (chunks.back() + chunk_bytes < end)
+	{
+		const char* next = static_cast<const char*>(memchr(chunks.back() + chunk_bytes, '\n', end - chunks.back() - chunk_bytes));
+		if (next == nullptr) break;
+		chunks.push_back(next + 1);
+	}
+	chunks.push_back(end);
+	const size_t nchunks = chunks.size() - 1;
+
+	// first pass: rows of every chunk
+	vector<size_t> chunk_row(nchunks + 1, 0);
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, nchunks),
+		[&](const tbb::blocked_range<size_t>& br)
+	{
+		for (size_t ik = br.begin(); ik != br.end(); ik++)
+		{
+			const char* cb = chunks[ik];
+			const char* ce = chunks[ik + 1];
+			size_t nlines = 0;
+			while (cb < ce)
+			{
+				const char* eol = static_cast<const char*>(memchr(cb, '\n', ce - cb));
+				nlines++;
+				cb = eol == nullptr ? ce : eol + 1;
+			}
+			chunk_row[ik + 1] = nlines;
+		}
+	});
+	for (size_t ik = 0; ik < nchunks; ik++)
+		chunk_row[ik + 1] += chunk_row[ik];
+
+	const size_t nrows = beg < end ? chunk_row[nchunks] : 0;
+	lut.set_size(nrows, ncols);
+	float* const dst = lut.memptr();
+
+	// second pass: parse every row straight into the (column-major) matrix
+	std::atomic<bool> failed{ false };
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, nrows > 0 ? nchunks : 0),
+		[&](const tbb::blocked_range<size_t>& br)
+	{
+		for (size_t ik = br.begin(); ik != br.end() && !failed; ik++)
+		{
+			const char* cb = chunks[ik];
+			const char* ce = chunks[ik + 1];
+			for (size_t ir = chunk_row[ik]; cb < ce; ir++)
+			{
+				const char* eol = static_cast<const char*>(memchr(cb, '\n', ce - cb));
+				if (eol == nullptr) eol = ce;
+
+				if (parse_lut_row(cb, eol, dst + ir, nrows, ncols) != 0)
+				{
+					// report the first broken row only
+					if (!failed.exchange(true))
+					{
+						cout << "The LUT data is wrong at line " << ir + 2 << ", " << ncols << " elements are expected:\n"
+							<< string(cb, eol) << endl;
+					}
+					return;
+				}
+				cb = eol + 1;
+			}
+		}
+	});
+
+	if (failed) return 1;
+
+	return 0;
+}
+
+
+int write_lut_bin(const arma::fmat& lut, const myConfig& cfg, const std::string& bin_file)
+{
+	using namespace std;
+
+	const vector<arma::fvec> axes = config_axes(cfg);
+
+	uint64_t nnodes = 1;
+	for (const auto& axis : axes)
+		nnodes *= axis.n_elem;
+
+	const uint64_t nrows = lut.n_rows;
+	const uint64_t ncols = LUT_Q_NUM;
+	if (lut.n_cols != LUT_TEXT_COLS)
+	{
+		cout << "[Error] the LUT has " << lut.n_cols << " columns, " << LUT_TEXT_COLS << " are expected.\n";
+		return 1;
+	}
+	if (nnodes == 0 || nrows % nnodes != 0)
+	{
+		cout << "[Error] " << nrows << " LUT rows cannot be split into "
+			<< nnodes << " SZA/VZA/LOS/DEM nodes. Check the axis lists of the config file.\n";
+		return 1;
+	}
+
+	LutFileHeader header{};
+	header.n_cols = static_cast<uint32_t>(ncols);
+	header.n_rows = nrows;
+	header.block_rows = static_cast<uint32_t>(nrows / nnodes);
+
+	LutPrecision precision = LUT_FLOAT32;
+	if (parse_lut_precision(cfg.lut_precision, precision) != 0) return 1;
+	header.data_type = precision;
+
+	// reference rows of the clear and cloudy atmosphere inside a block
+	if (cfg.lut_clear_rows.n_elem != 2 || cfg.lut_clear_rows(0) > cfg.lut_clear_rows(1)
+		|| cfg.lut_clear_rows(1) >= header.block_rows)
+	{
+		cout << "[Error] lut_clear_rows must be the first and last clear row of a block of "
+			<< header.block_rows << " rows.\n";
+		return 1;
+	}
+	if (cfg.lut_cloudy_rows.n_elem == 0 || cfg.lut_cloudy_rows.n_elem > LUT_MAX_CLOUDY_ROWS
+		|| cfg.lut_cloudy_rows.max() >= header.block_rows)
+	{
+		cout << "[Error] lut_cloudy_rows must be 1 to " << LUT_MAX_CLOUDY_ROWS << " rows of a block of "
+			<< header.block_rows << " rows.\n";
+		return 1;
+	}
+	header.clear_row_st = static_cast<uint32_t>(cfg.lut_clear_rows(0));
+	header.clear_row_ed = static_cast<uint32_t>(cfg.lut_clear_rows(1));
+	header.n_cloudy_rows = static_cast<uint32_t>(cfg.lut_cloudy_rows.n_elem);
+	for (arma::uword ir = 0; ir < cfg.lut_cloudy_rows.n_elem; ir++)
+		header.cloudy_rows[ir] = static_cast<uint32_t>(cfg.lut_cloudy_rows(ir));
+
+	// the float values of one block of all the quantities
+	const size_t block_rows = header.block_rows;
+	auto fill_block = [&](uint64_t ib, float* block)
+	{
+		const size_t row = ib * block_rows;
+		for (size_t q = 0; q < ncols; q++)
+		{
+			const LutQuantityDef& def = LUT_QUANTITIES[q];
+			float* dst = block + q * block_rows;
+			const float* src = lut.colptr(def.col) + row;
+			for (size_t ir = 0; ir < block_rows; ir++)
+				dst[ir] = src[ir];
+
+			if (def.add_col >= 0)
+			{
+				const float* src2 = lut.colptr(def.add_col) + row;
+				for (size_t ir = 0; ir < block_rows; ir++)
+					dst[ir] += src2[ir];
+			}
+		}
+		return 0;
+	};
+
+	// range of every quantity for the int16 storage
+	vector<float> scale(ncols, 1.0f);
+	vector<float> offset(ncols, 0.0f);
+	if (precision == LUT_INT16)
+	{
+		vector<float> block(ncols * block_rows);
+		vector<float> vmin(ncols, numeric_limits<float>::max());
+		vector<float> vmax(ncols, -numeric_limits<float>::max());
+		for (uint64_t ib = 0; ib < nnodes; ib++)
+		{
+			fill_block(ib, block.data());
+			for (size_t q = 0; q < ncols; q++)
+			{
+				const float* val = block.data() + q * block_rows;
+				for (size_t ir = 0; ir < block_rows; ir++)
+				{
+					vmin[q] = min(vmin[q], val[ir]);
+					vmax[q] = max(vmax[q], val[ir]);
+				}
+			}
+		}
+		for (size_t q = 0; q < ncols; q++)
+			int16_scale(vmin[q], vmax[q], scale[q], offset[q]);
+	}
+
+	return write_lut_blocks(header, axes, scale, offset, fill_block, bin_file);
+}
+
+int LutStore::write_subset(const std::vector<arma::uvec>& nodes, const arma::uvec& rows,
+	const std::string& bin_file) const
+{
+	using namespace std;
+
+	//-------------------------------------------------------------
+	// the kept nodes and rows must be inside the LUT, in ascending order
+	if (nodes.size() != LUT_AXIS_NUM || rows.n_elem == 0)
+	{
+		cout << "[Error] the LUT subset needs the nodes of " << LUT_AXIS_NUM << " axes and the rows of a block.\n";
+		return 1;
+	}
+	for (int ia = 0; ia < LUT_AXIS_NUM; ia++)
+	{
+		const arma::uvec& idx = nodes[ia];
+		if (idx.n_elem == 0 || idx.max() >= m_header.axis_len[ia] || !idx.is_sorted("strictascend"))
+		{
+			cout << "[Error] invalid " << axis_name(ia) << " nodes of the LUT subset.\n";
+			return 1;
+		}
+	}
+	if (rows.max() >= m_header.block_rows || !rows.is_sorted("strictascend"))
+	{
+		cout << "[Error] invalid block rows of the LUT subset.\n";
+		return 1;
+	}
+
+	// row of a block -> row of a subset block
+	const arma::uword no_row = m_header.block_rows;
+	arma::uvec new_row(m_header.block_rows);
+	new_row.fill(no_row);
+	for (arma::uword ir = 0; ir < rows.n_elem; ir++)
+		new_row(rows(ir)) = ir;
+
+	// the clear rows stay contiguous and the cloudy rows are kept
+	LutFileHeader header{};
+	for (arma::uword ir = m_header.clear_row_st; ir <= m_header.clear_row_ed; ir++)
+	{
+		if (new_row(ir) == no_row)
+		{
+			cout << "[Error] the LUT subset must keep the clear rows "
+				<< m_header.clear_row_st << " - " << m_header.clear_row_ed << endl;
+			return 1;
+		}
+	}
+	header.clear_row_st = static_cast<uint32_t>(new_row(m_header.clear_row_st));
+	header.clear_row_ed = static_cast<uint32_t>(new_row(m_header.clear_row_ed));
+	header.n_cloudy_rows = m_header.n_cloudy_rows;
+	for (uint32_t ir = 0; ir < m_header.n_cloudy_rows; ir++)
+	{
+		if (new_row(m_header.cloudy_rows[ir]) == no_row)
+		{
+			cout << "[Error] the LUT subset must keep the cloudy row " << m_header.cloudy_rows[ir] << endl;
+			return 1;
+		}
+		header.cloudy_rows[ir] = static_cast<uint32_t>(new_row(m_header.cloudy_rows[ir]));
+	}
+
+	//-------------------------------------------------------------
+	vector<arma::fvec> axes(LUT_AXIS_NUM);
+	uint64_t nnodes = 1;
+	for (int ia = 0; ia < LUT_AXIS_NUM; ia++)
+	{
+		axes[ia] = m_axes[ia](nodes[ia]);
+		nnodes *= nodes[ia].n_elem;
+	}
+
+	const size_t ncols = m_header.n_cols;
+	header.n_cols = m_header.n_cols;
+	header.block_rows = static_cast<uint32_t>(rows.n_elem);
+	header.n_rows = nnodes * rows.n_elem;
+	header.data_type = m_header.data_type;
+
+	// subset block ib -> block of this LUT, the DEM node runs fastest
+	arma::fmat block_in(m_header.block_rows, ncols);
+	auto fill_block = [&](uint64_t ib, float* block)
+	{
+		arma::uword first_row = 0;
+		for (int ia = LUT_AXIS_NUM - 1; ia >= 0; ia--)
+		{
+			const arma::uword len = nodes[ia].n_elem;
+			first_row += nodes[ia](ib % len) * m_header.row_stride[ia];
+			ib /= len;
+		}
+
+		if (copy_rows(first_row, m_header.block_rows, block_in, 0) != 0) return 1;
+		for (size_t q = 0; q < ncols; q++)
+		{
+			float* dst = block + q * rows.n_elem;
+			const float* src = block_in.colptr(q);
+			for (arma::uword ir = 0; ir < rows.n_elem; ir++)
+				dst[ir] = src[rows(ir)];
+		}
+		return 0;
+	};
+
+	// the int16 values are re-encoded with the scale and offset of this LUT
+	return write_lut_blocks(header, axes, m_scale, m_offset, fill_block, bin_file);
+}
@@ -7,6 +7,7 @@
 #include "parse_cmd_vars.h"
 #include "batch_run.h"
 
+#include <filesystem>
 #include <string>
 
 int main(int argc, char* argv[])
@@ -18,8 +19,9 @@ int main(int argc, char* argv[])
 	cout << "\nSWDR MODIS retrieval model V1.0\n";
 	cout << "\n***********************************************\n";
 
-	//cmdVars cv;
-	//if (cv.parse_cmd_vars(argc, argv) != 0) return 1;
+	//cfg=, ip=, op= and max_tile_bytes= if given, otherwise the test paths below
+	cmdVars cv;
+	if (argc > 1 && cv.parse_cmd_vars(argc, argv) != 0) return 1;
 
 	///for test----------------------------------------------
 	//string m_cfg_file = R"(G:\29_paper1\01_validation\00_LUT\ahi_swdr_mat.cfg)";
@@ -29,10 +31,17 @@ int main(int argc, char* argv[])
 	string m_in_path = R"(/root/v1.0/swdrModis/data/inputdata/)";
 	string m_out_path = R"(/root/v1.0/swdrModis/data/output/)";
 	//-------------------------------------------------------
+	if (argc > 1)
+	{
+		m_cfg_file = cv.m_cfg_file;
+		m_in_path = cv.m_in_path;
+		m_out_path = cv.m_out_path;
+	}
 
 	myConfig mycfg;
-	/*mycfg.read_config(cv.m_cfg_file);*/
-	mycfg.read_config(m_cfg_file);
+	if (mycfg.read_config(m_cfg_file) != 0) return 1;
+	//the command line max_tile_bytes overrides the cfg file
+	if (cv.m_max_tile_bytes >= 0) mycfg.max_tile_bytes = cv.m_max_tile_bytes;
 	mycfg.print();
 
 	//string flag;
@@ -63,7 +72,19 @@ int main(int argc, char* argv[])
 	arma::wall_clock timer;
 	timer.tic();
 
-	if (mycfg.cpu_core_num == 0)
+	if (mycfg.run_mode == "plan")
+	{
+		cout << "\n => Plan run...\n";
+
+		ahi_swdr ahisdr(mycfg);
+		const string plan_file = (std::filesystem::path(out_path) / "swdr_plan.json").u8string();
+		if (ahisdr.plan_run(mycfg, in_path, plan_file) != 0)
+		{
+			cout << "The failure happended in the plan.\n";
+			return 1;
+		}
+	}
+	else if (mycfg.cpu_core_num == 0)
 	{
 		cout << "\n => Sequential run...\n";
 
@@ -7,7 +7,7 @@
 #include <string>
 
 
-cmdVars::cmdVars(): m_cfg_file(""),m_in_path(""),m_out_path("")
+cmdVars::cmdVars(): m_cfg_file(""),m_in_path(""),m_out_path(""),m_max_tile_bytes(-1)
 {
 }
 
@@ -16,10 +16,10 @@ int cmdVars::parse_cmd_vars(int argc, char * argv[])
 	using namespace std;
 	namespace fs = std::filesystem;
 
-	if (argc != 4)
+	if (argc != 4 && argc != 5)
 	{
 		cout << "The input argument is wrong.\n";
-		cout << "ahi_swdr.exe cfg=[xxx].cfg in_path=xxx out_path=xxx\n";
+		cout << "ahi_swdr.exe cfg=[xxx].cfg ip=xxx op=xxx [max_tile_bytes=xxx]\n";
 		return 1;
 	}
 
@@ -94,6 +94,15 @@ int cmdVars::parse_cmd_vars(int argc, char * argv[])
 
 			m_out_path = var_value;
 		}
+		else if (var_key == "max_tile_bytes")
+		{
+			m_max_tile_bytes = stoll(var_value);
+			if (m_max_tile_bytes < 0)
+			{
+				cerr << "max_tile_bytes is wrong: " << var_value << endl;
+				return 1;
+			}
+		}
 		else
 		{
 			cerr << "cmd argument is wrong." << endl;
@@ -116,5 +125,7 @@ void cmdVars::print()
 	cout << "The cfg file:    " << m_cfg_file << endl;
 	cout << "The input path:  " << m_in_path << endl;
 	cout << "The output path: " << m_out_path << endl;
+	if (m_max_tile_bytes >= 0)
+		cout << "Max tile bytes:  " << m_max_tile_bytes << endl;
 	cout << "\n-----------------------------\n";
 }
@@ -15,6 +15,20 @@ myConfig::myConfig()
 	int ref_bin_num = 5;
 	// f_Std		std for TOA and surface cases average; times of the std; default = 1.0
 	float f_std = 1.0;
+
+	lut_precision = "float32";
+	lut_huge_pages = "none";
+	lut_numa = "none";
+	lut_compression = "none";
+	cell_batch_pixels = 0;
+	strip_rows = 0;
+	max_tile_bytes = 0;
+	run_mode = "retrieve";
+	plan_row_cost_ns = 2.0;
+
+	//--FY-3D-- clear: VIS=20km, COD=0; cloudy: VIS=20km, COD=60
+	lut_clear_rows = { 72, 77 };
+	lut_cloudy_rows = { 243, 257, 271 };
 }
 
 myConfig::~myConfig() = default;
@@ -86,6 +100,49 @@ int myConfig::read_config(const std::string& cfg_file)
 
 		if (key == "lut_file")
 			lut_file = value;
+		else if (key == "lut_shm_name")
+			lut_shm_name = value;
+		else if (key == "lut_precision")
+		{
+			lut_precision = value;
+			boost::algorithm::to_lower(lut_precision);
+			if (lut_precision != "float32" && lut_precision != "float16"
+				&& lut_precision != "bfloat16" && lut_precision != "int16")
+			{
+				cout << "[Error] lut_precision must be float32, float16, bfloat16 or int16: " << value << endl;
+				return 1;
+			}
+		}
+		else if (key == "lut_huge_pages")
+		{
+			lut_huge_pages = value;
+			boost::algorithm::to_lower(lut_huge_pages);
+			if (lut_huge_pages != "none" && lut_huge_pages != "transparent" && lut_huge_pages != "explicit")
+			{
+				cout << "[Error] lut_huge_pages must be none, transparent or explicit: " << value << endl;
+				return 1;
+			}
+		}
+		else if (key == "lut_numa")
+		{
+			lut_numa = value;
+			boost::algorithm::to_lower(lut_numa);
+			if (lut_numa != "none" && lut_numa != "interleave" && lut_numa != "replicate")
+			{
+				cout << "[Error] lut_numa must be none, interleave or replicate: " << value << endl;
+				return 1;
+			}
+		}
+		else if (key == "lut_compression")
+		{
+			lut_compression = value;
+			boost::algorithm::to_lower(lut_compression);
+			if (lut_compression != "none" && lut_compression != "zstd")
+			{
+				cout << "[Error] lut_compression must be none or zstd: " << value << endl;
+				return 1;
+			}
+		}
 		else if (key == "toa_avg_num")
 			toa_avg_num = stoi(value);
 		else if (key == "ref_range")
@@ -114,6 +171,53 @@ int myConfig::read_config(const std::string& cfg_file)
 				return 1;
 			}
 		}
+		else if (key == "cell_batch_pixels")
+		{
+			cell_batch_pixels = stoi(value);
+			if (cell_batch_pixels < 0)
+			{
+				cout << "[Error] cell_batch_pixels cannot be negative: " << value << endl;
+				return 1;
+			}
+		}
+		else if (key == "strip_rows")
+		{
+			strip_rows = stoi(value);
+			if (strip_rows < 0)
+			{
+				cout << "[Error] strip_rows cannot be negative: " << value << endl;
+				return 1;
+			}
+		}
+		else if (key == "max_tile_bytes")
+		{
+			const long long bytes = stoll(value);
+			if (bytes < 0)
+			{
+				cout << "[Error] max_tile_bytes cannot be negative: " << value << endl;
+				return 1;
+			}
+			max_tile_bytes = bytes;
+		}
+		else if (key == "run_mode")
+		{
+			run_mode = value;
+			boost::algorithm::to_lower(run_mode);
+			if (run_mode != "retrieve" && run_mode != "plan")
+			{
+				cout << "[Error] run_mode must be retrieve or plan: " << value << endl;
+				return 1;
+			}
+		}
+		else if (key == "plan_row_cost_ns")
+		{
+			plan_row_cost_ns = stof(value);
+			if (plan_row_cost_ns <= 0)
+			{
+				cout << "[Error] plan_row_cost_ns must be positive: " << value << endl;
+				return 1;
+			}
+		}
 		else if (key == "sza_list")
 		{
 			if (parse_list(value, sza_list) != 0) return 1;
@@ -130,6 +234,14 @@ int myConfig::read_config(const std::string& cfg_file)
 		{
 			if (parse_list(value, los_list) != 0) return 1;
 		}
+		else if (key == "lut_clear_rows")
+		{
+			if (parse_list(value, lut_clear_rows) != 0) return 1;
+		}
+		else if (key == "lut_cloudy_rows")
+		{
+			if (parse_list(value, lut_cloudy_rows) != 0) return 1;
+		}
 		else
 		{
 			cout << "[Error] cannot find the correct key: " << key
@@ -148,6 +260,12 @@ void myConfig::print()
 	cout << "\nParse config file arguments: \n";
 	cout << "------------------------------\n";
 	cout << "LUT file     : " << lut_file << endl;
+	if (lut_shm_name.length() > 0)
+		cout << "LUT shm name : " << lut_shm_name << endl;
+	cout << "LUT precision: " << lut_precision << endl;
+	cout << "LUT pages    : " << lut_huge_pages << endl;
+	cout << "LUT NUMA     : " << lut_numa << endl;
+	cout << "LUT compress : " << lut_compression << endl;
 	cout << "toa_avg_num  : " << toa_avg_num << endl;
 	cout << "ref_range    : " << ref_range << endl;
 	cout << "ref_bin_num  : " << ref_bin_num << endl;
@@ -184,6 +302,25 @@ void myConfig::print()
 	else
 		printf("CPU number   : %d    ==> parallel run.\n", cpu_core_num);
 
+	if (cell_batch_pixels == 0)
+		printf("cell batch   : %d    ==> one call per cell.\n", cell_batch_pixels);
+	else
+		printf("cell batch   : %d    pixels per call of the small cells.\n", cell_batch_pixels);
+
+	if (strip_rows == 0)
+		printf("strip rows   : %d    ==> whole image at once.\n", strip_rows);
+	else
+		printf("strip rows   : %d    rows per strip.\n", strip_rows);
+
+	if (max_tile_bytes == 0)
+		printf("tile budget  : %llu    ==> no limit.\n", (unsigned long long)max_tile_bytes);
+	else
+		printf("tile budget  : %llu    bytes of tiles per get_SWDR call.\n", (unsigned long long)max_tile_bytes);
+
+	cout << "run mode     : " << run_mode << endl;
+	if (run_mode == "plan")
+		cout << "row cost     : " << plan_row_cost_ns << " ns per pixel and LUT row" << endl;
+
 	cout << "------------------------------\n";
 }
 
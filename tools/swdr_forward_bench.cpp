@@ -0,0 +1,214 @@
+// Forward model of the matching bands in get_SWDR: time and bytes moved per pixel
+//
+//   swdr_forward_bench [LUT rows per cell, default 2880] [pixels, default 4096] [repeats, default 10]
+//
+// TOA radiances of bands 1, 3, 4, 6, 7 and the NDSI over the LUT rows of one cell for every pixel, as
+// (1) tiles:    the LUT columns replicated over the pixels, then Armadillo expressions per band
+// (2) per band: one pass per band over the LUT columns, then the NDSI from the band 4/6 tiles
+// (3) fused:    forward_bands, one pass for all the bands and the NDSI, per instruction set of the CPU
+// The bytes are the loads and stores of the float arrays of the LUT rows per pixel, caches not counted.
+#include "forward_kernel.h"
+
+#include <armadillo>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+	const char* BAND_NAMES[FWD_BAND_NUM] = { "band1", "band3", "band4", "band6", "band7" };
+
+	// rows of a DEM block of the FY-3D LUT (block_rows of its header), a cell holds 8 blocks
+	const arma::uword FY3D_BLOCK_ROWS = 360;
+
+	struct Inputs
+	{
+		arma::fmat i0;                   // column b = band b
+		arma::fmat rho;
+		arma::fmat cplx;
+		arma::fmat ref;                  // surface reflectance, row b = band b, column j = pixel j
+	};
+
+	// radiances of the bands except band 4 and the NDSI, as forward_bands
+	struct Outputs
+	{
+		arma::fmat tile[FWD_OUT_NUM];
+
+		void set_size(arma::uword nrows, arma::uword npixels)
+		{
+			for (int k = 0; k < FWD_OUT_NUM; k++)
+				tile[k].set_size(nrows, npixels);
+		}
+	};
+
+	// (1) 12 passes per band (3 copies, i0x, radiance), 3 for the NDSI
+	void run_tiles(const Inputs& in, Outputs& out)
+	{
+		using namespace arma;
+
+		const uword nrows = in.i0.n_rows;
+		const uword npixels = in.ref.n_cols;
+		auto replicate = [&](const fmat& lut, int b)
+		{
+			fmat tile(nrows, npixels);
+			for (uword j = 0; j < npixels; j++)
+				memcpy(tile.colptr(j), lut.colptr(b), nrows * sizeof(float));
+			return tile;
+		};
+
+		fmat rad[FWD_BAND_NUM];
+		for (int b = 0; b < FWD_BAND_NUM; b++)
+		{
+			const fmat i0_tile = replicate(in.i0, b);
+			const fmat rho_tile = replicate(in.rho, b);
+			const fmat cplx_tile = replicate(in.cplx, b);
+			const fmat i0x = (1 / in.ref.row(b)) - rho_tile.each_row();
+			rad[b] = i0_tile + (1 / i0x) % cplx_tile;
+		}
+		out.tile[FWD_OUT_B1] = rad[FWD_B1];
+		out.tile[FWD_OUT_B3] = rad[FWD_B3];
+		out.tile[FWD_OUT_B6] = rad[FWD_B6];
+		out.tile[FWD_OUT_B7] = rad[FWD_B7];
+		out.tile[FWD_OUT_NDSI] = (rad[FWD_B4] / 593.84 - rad[FWD_B6] / 76.53) / (rad[FWD_B4] / 593.84 + rad[FWD_B6] / 76.53);
+	}
+
+	// (2) 4 passes per band (3 columns, radiance), 3 for the NDSI
+	void run_per_band(const Inputs& in, Outputs& out)
+	{
+		using namespace arma;
+
+		const uword nrows = in.i0.n_rows;
+		const uword npixels = in.ref.n_cols;
+		fmat rad[FWD_BAND_NUM];
+		for (int b = 0; b < FWD_BAND_NUM; b++)
+		{
+			rad[b].set_size(nrows, npixels);
+			const float* i0 = in.i0.colptr(b);
+			const float* rho = in.rho.colptr(b);
+			const float* cplx = in.cplx.colptr(b);
+			for (uword j = 0; j < npixels; j++)
+			{
+				const float inv_x = 1 / in.ref(b, j);
+				float* col = rad[b].colptr(j);
+				for (uword r = 0; r < nrows; r++)
+					col[r] = i0[r] + (1 / (inv_x - rho[r])) * cplx[r];
+			}
+		}
+		out.tile[FWD_OUT_B1] = std::move(rad[FWD_B1]);
+		out.tile[FWD_OUT_B3] = std::move(rad[FWD_B3]);
+		out.tile[FWD_OUT_B6] = std::move(rad[FWD_B6]);
+		out.tile[FWD_OUT_B7] = std::move(rad[FWD_B7]);
+		out.tile[FWD_OUT_NDSI] = (rad[FWD_B4] / 593.84 - rad[FWD_B6] / 76.53) / (rad[FWD_B4] / 593.84 + rad[FWD_B6] / 76.53);
+	}
+
+	// (3) 15 loads and 5 stores per LUT row
+	void run_fused(const Inputs& in, Outputs& out)
+	{
+		using namespace arma;
+
+		const uword nrows = in.i0.n_rows;
+		const uword npixels = in.ref.n_cols;
+		out.set_size(nrows, npixels);
+
+		ForwardColumns cols;
+		for (int b = 0; b < FWD_BAND_NUM; b++)
+		{
+			cols.i0[b] = in.i0.colptr(b);
+			cols.rho[b] = in.rho.colptr(b);
+			cols.cplx[b] = in.cplx.colptr(b);
+		}
+		for (uword j = 0; j < npixels; j++)
+		{
+			float inv_ref[FWD_BAND_NUM];
+			for (int b = 0; b < FWD_BAND_NUM; b++)
+				inv_ref[b] = 1 / in.ref(b, j);
+			float* const dst[FWD_OUT_NUM] = { out.tile[0].colptr(j), out.tile[1].colptr(j), out.tile[2].colptr(j),
+				out.tile[3].colptr(j), out.tile[4].colptr(j) };
+			forward_bands(cols, inv_ref, nrows, dst);
+		}
+	}
+
+	// elements of out different from ref, NaN equal to NaN
+	arma::uword count_diff(const Outputs& ref, const Outputs& out)
+	{
+		arma::uword ndiff = 0;
+		for (int k = 0; k < FWD_OUT_NUM; k++)
+		{
+			for (arma::uword i = 0; i < ref.tile[k].n_elem; i++)
+			{
+				const float a = ref.tile[k](i);
+				const float b = out.tile[k](i);
+				if (a != b && !(std::isnan(a) && std::isnan(b))) ndiff++;
+			}
+		}
+		return ndiff;
+	}
+
+	template <typename Func>
+	void bench(const std::string& name, Func run, const Inputs& in, int repeats, double passes,
+		const Outputs* ref, Outputs& out)
+	{
+		const double npixels = in.ref.n_cols;
+		const double bytes = passes * in.i0.n_rows * sizeof(float);
+
+		run(in, out);
+		arma::wall_clock timer;
+		timer.tic();
+		for (int it = 0; it < repeats; it++)
+			run(in, out);
+		const double seconds = timer.toc() / repeats;
+
+		printf("%-18s %10.1f bytes/pixel  %10.1f ns/pixel  %8.2f GB/s",
+			name.c_str(), bytes, seconds / npixels * 1.0e9, bytes * npixels / seconds / 1.0e9);
+		if (ref != nullptr) printf("  %llu values differ", (unsigned long long)count_diff(*ref, out));
+		printf("\n");
+	}
+}
+
+
+int main(int argc, char* argv[])
+{
+	using namespace std;
+
+	if (argc > 4)
+	{
+		cout << "Usage: " << argv[0] << " [LUT rows per cell] [pixels] [repeats]\n";
+		return 1;
+	}
+	const arma::uword nrows = (argc > 1) ? stoul(argv[1]) : 8 * FY3D_BLOCK_ROWS;
+	const arma::uword npixels = (argc > 2) ? stoul(argv[2]) : 4096;
+	const int repeats = (argc > 3) ? stoi(argv[3]) : 10;
+
+	//LUT values and reflectances in the ranges of the FY-3D LUT
+	arma::arma_rng::set_seed(1);
+	Inputs in;
+	in.i0 = arma::randu<arma::fmat>(nrows, FWD_BAND_NUM) * 100;
+	in.rho = arma::randu<arma::fmat>(nrows, FWD_BAND_NUM) * 0.5f;
+	in.cplx = arma::randu<arma::fmat>(nrows, FWD_BAND_NUM) * 100;
+	in.ref = arma::randu<arma::fmat>(FWD_BAND_NUM, npixels) * 0.8f + 0.05f;
+
+	cout << "LUT rows: " << nrows << ", pixels: " << npixels << ", bands:";
+	for (const char* band : BAND_NAMES)
+		cout << " " << band;
+	cout << " + NDSI\n\n";
+
+	Outputs out_tiles;
+	Outputs out;
+	bench("tiles", run_tiles, in, repeats, 5 * 12 + 3, nullptr, out_tiles);
+	bench("per band", run_per_band, in, repeats, 5 * 4 + 3, &out_tiles, out);
+	for (const string isa : { "scalar", "avx2", "avx512" })
+	{
+		if (forward_kernel_select(isa) != 0)
+		{
+			cout << "fused " << isa << ": not supported by this CPU\n";
+			continue;
+		}
+		bench("fused " + isa, run_fused, in, repeats, 5 * 3 + 5, &out_tiles, out);
+	}
+
+	return 0;
+}
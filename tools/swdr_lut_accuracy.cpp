@@ -0,0 +1,199 @@
+// Accuracy of a reduced precision LUT against the float32 LUT
+//
+//   swdr_lut_accuracy <cfg file> <float16|bfloat16|int16> [input tif]
+//
+// (1) the fluxes SWDR, PAR, UVA and UVB of every LUT row for a set of surface albedos
+// (2) with an input image, the retrieved SWDR/PAR/UVA/UVB of both LUTs
+#include "ahi_swdr.h"
+#include "file_io.h"
+#include "lut_store.h"
+#include "read_config_file.h"
+
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+	struct ErrStat
+	{
+		double max_abs = 0;
+		double sum_abs = 0;
+		double max_rel = 0;
+		size_t num = 0;
+
+		void add(double ref, double val)
+		{
+			const double err = std::abs(val - ref);
+			max_abs = std::max(max_abs, err);
+			sum_abs += err;
+			if (std::abs(ref) > 1.0) max_rel = std::max(max_rel, err / std::abs(ref));
+			num++;
+		}
+
+		void print(const std::string& name) const
+		{
+			printf("%-12s max abs: %12.6f  mean abs: %12.6f  max rel: %10.6f %%  (%zu)\n",
+				name.c_str(), max_abs, num > 0 ? sum_abs / num : 0.0, max_rel * 100, num);
+		}
+	};
+
+	// f0 + f0x / (1 - f0x) * complex, f0x = albedo * rho, as get_SWDR
+	float flux(const arma::fmat& lut, arma::uword ir, int q_f0, int q_rho, int q_cplx, float albedo)
+	{
+		const float f0x = albedo * lut(ir, q_rho);
+		return lut(ir, q_f0) + f0x / (1 - f0x) * lut(ir, q_cplx);
+	}
+
+	int compare_lut(const LutStore& lut_ref, const LutStore& lut_low)
+	{
+		using namespace std;
+
+		const vector<float> albedos = { 0.05f, 0.1f, 0.2f, 0.4f, 0.6f, 0.8f };
+		const vector<string> names = { "SWDR", "PAR", "UVA", "UVB" };
+		const int q_flux[4][3] = {
+			{ LUT_Q_SW_F0, LUT_Q_SW_RHO, LUT_Q_SW_CPLX },
+			{ LUT_Q_PAR_F0, LUT_Q_PAR_RHO, LUT_Q_PAR_CPLX },
+			{ LUT_Q_UVA_F0, LUT_Q_UVA_RHO, LUT_Q_UVA_CPLX },
+			{ LUT_Q_UVB_F0, LUT_Q_UVB_RHO, LUT_Q_UVB_CPLX } };
+
+		vector<ErrStat> quantity_err(LUT_Q_NUM);
+		vector<ErrStat> flux_err(names.size());
+
+		const arma::uword block_rows = lut_ref.block_rows();
+		arma::fmat tile_ref(block_rows, LUT_Q_NUM);
+		arma::fmat tile_low(block_rows, LUT_Q_NUM);
+		for (arma::uword row = 0; row < lut_ref.n_rows(); row += block_rows)
+		{
+			if (lut_ref.copy_rows(row, block_rows, tile_ref, 0) != 0 || lut_low.copy_rows(row, block_rows, tile_low, 0) != 0)
+			{
+				cout << "[Error] cannot read the LUT rows from " << row << endl;
+				return 1;
+			}
+
+			for (arma::uword q = 0; q < LUT_Q_NUM; q++)
+			{
+				for (arma::uword ir = 0; ir < block_rows; ir++)
+					quantity_err[q].add(tile_ref(ir, q), tile_low(ir, q));
+			}
+
+			for (size_t ip = 0; ip < names.size(); ip++)
+			{
+				for (const float albedo : albedos)
+				{
+					for (arma::uword ir = 0; ir < block_rows; ir++)
+					{
+						flux_err[ip].add(flux(tile_ref, ir, q_flux[ip][0], q_flux[ip][1], q_flux[ip][2], albedo),
+							flux(tile_low, ir, q_flux[ip][0], q_flux[ip][1], q_flux[ip][2], albedo));
+					}
+				}
+			}
+		}
+
+		cout << "\n(1) LUT quantities\n";
+		cout << "--------------------------------------------------\n";
+		for (arma::uword q = 0; q < LUT_Q_NUM; q++)
+			quantity_err[q].print(lut_ref.col_name(q));
+
+		cout << "\n(1) LUT fluxes, albedo 0.05 - 0.8 (W/m2)\n";
+		cout << "--------------------------------------------------\n";
+		for (size_t ip = 0; ip < names.size(); ip++)
+			flux_err[ip].print(names[ip]);
+
+		return 0;
+	}
+
+	int compare_image(const myConfig& cfg_ref, const myConfig& cfg_low,
+		const std::shared_ptr<const LutStore>& lut_ref, const std::shared_ptr<const LutStore>& lut_low,
+		const std::string& in_file)
+	{
+		using namespace std;
+		namespace fs = std::filesystem;
+
+		const fs::path tmp_path = fs::temp_directory_path();
+		const string name = fs::path(in_file).stem().u8string();
+		const string out_ref = (tmp_path / (name + "_float32.tif")).u8string();
+		const string out_low = (tmp_path / (name + "_" + cfg_low.lut_precision + ".tif")).u8string();
+
+		ahi_swdr swdr_ref(cfg_ref, lut_ref);
+		if (swdr_ref.retrieve_image(in_file, out_ref) != 0) return 1;
+
+		ahi_swdr swdr_low(cfg_low, lut_low);
+		if (swdr_low.retrieve_image(in_file, out_low) != 0) return 1;
+
+		arma::fcube data_ref;
+		arma::fcube data_low;
+		if (read_3d_geotif(out_ref, data_ref) != 0) return 1;
+		if (read_3d_geotif(out_low, data_low) != 0) return 1;
+
+		// slices and scale factors of the output file
+		const vector<string> names = { "SWDR", "SW_DIR", "PAR", "PAR_DIR", "UVA", "UVB" };
+		const vector<float> scales = { 10, 10, 10, 10, 200, 1000 };
+
+		cout << "\n(2) retrieval of " << in_file << " (W/m2)\n";
+		cout << "--------------------------------------------------\n";
+		for (size_t is = 0; is < names.size(); is++)
+		{
+			ErrStat err;
+			size_t invalid = 0;
+			const arma::fmat& ref = data_ref.slice(is);
+			const arma::fmat& low = data_low.slice(is);
+			for (arma::uword ii = 0; ii < ref.n_elem; ii++)
+			{
+				if (ref(ii) < 0 && low(ii) < 0) continue;
+				if (ref(ii) < 0 || low(ii) < 0)
+				{
+					invalid++;
+					continue;
+				}
+				err.add(ref(ii) / scales[is], low(ii) / scales[is]);
+			}
+			err.print(names[is]);
+			if (invalid > 0) cout << "             valid in only one of the results: " << invalid << endl;
+		}
+
+		fs::remove(out_ref);
+		fs::remove(out_low);
+		return 0;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	using namespace std;
+
+	if (argc != 3 && argc != 4)
+	{
+		cout << "Usage: " << argv[0] << " <cfg file> <float16|bfloat16|int16> [input tif]\n";
+		return 1;
+	}
+
+	myConfig cfg_ref;
+	if (cfg_ref.read_config(argv[1]) != 0) return 1;
+	// the shared memory segment holds one precision only
+	cfg_ref.lut_shm_name = "";
+
+	myConfig cfg_low = cfg_ref;
+	cfg_ref.lut_precision = "float32";
+	cfg_low.lut_precision = argv[2];
+
+	LutPrecision precision;
+	if (parse_lut_precision(cfg_low.lut_precision, precision) != 0) return 1;
+
+	shared_ptr<const LutStore> lut_ref;
+	shared_ptr<const LutStore> lut_low;
+	if (load_lut_store(cfg_ref, lut_ref) != 0) return 1;
+	if (load_lut_store(cfg_low, lut_low) != 0) return 1;
+
+	cout << "\nLUT precision " << lut_precision_name(precision) << " against float32\n";
+	if (compare_lut(*lut_ref, *lut_low) != 0) return 1;
+
+	if (argc == 4)
+	{
+		if (compare_image(cfg_ref, cfg_low, lut_ref, lut_low, argv[3]) != 0) return 1;
+	}
+
+	return 0;
+}
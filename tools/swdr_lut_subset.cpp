@@ -0,0 +1,255 @@
+// Subset of the binary LUT for a family of scenes
+//
+//   swdr_lut_subset <cfg file> <out .swlut> [sza=min:max] [vza=min:max] [los=min:max] [dem=min:max]
+//                   [rows=st:ed,st:ed,...] [scenes=<input tif or directory>]
+//
+// Only the SZA/VZA/LOS/DEM nodes around the given ranges are kept; the ranges not given are taken
+// from the valid pixels of the scenes, or keep the whole axis. rows= keeps these rows of every block,
+// they must include the clear and cloudy reference rows.
+// The retrieval reads the subset unchanged with lut_file = <out .swlut> in the config file.
+#include "file_io.h"
+#include "lut_store.h"
+#include "read_config_file.h"
+
+#include <boost/algorithm/string.hpp>
+
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+	struct AxisRange
+	{
+		bool given = false;
+		float vmin = std::numeric_limits<float>::max();
+		float vmax = -std::numeric_limits<float>::max();
+
+		void add(float val)
+		{
+			vmin = std::min(vmin, val);
+			vmax = std::max(vmax, val);
+		}
+	};
+
+	int parse_range(const std::string& value, AxisRange& range)
+	{
+		std::vector<std::string> pack;
+		boost::split(pack, value, boost::is_any_of(":"));
+		if (pack.size() != 2)
+		{
+			std::cout << "[Error] a range is min:max: " << value << std::endl;
+			return 1;
+		}
+
+		range.vmin = std::stof(pack[0]);
+		range.vmax = std::stof(pack[1]);
+		range.given = true;
+		if (range.vmin > range.vmax)
+		{
+			std::cout << "[Error] the minimum of a range is larger than the maximum: " << value << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	int parse_rows(const std::string& value, arma::uword block_rows, arma::uvec& rows)
+	{
+		arma::uvec keep(block_rows, arma::fill::zeros);
+
+		std::vector<std::string> items;
+		boost::split(items, value, boost::is_any_of(","));
+		for (auto item : items)
+		{
+			boost::trim(item);
+			std::vector<std::string> pack;
+			boost::split(pack, item, boost::is_any_of(":"));
+
+			const arma::uword st = std::stoul(pack[0]);
+			const arma::uword ed = pack.size() > 1 ? std::stoul(pack[1]) : st;
+			if (pack.size() > 2 || st > ed || ed >= block_rows)
+			{
+				std::cout << "[Error] rows are st:ed inside a block of " << block_rows << " rows: " << item << std::endl;
+				return 1;
+			}
+			keep.subvec(st, ed).fill(1);
+		}
+
+		rows = arma::find(keep);
+		return 0;
+	}
+
+	// SZA/VZA/LOS/DEM ranges of the valid pixels, as read by ahi_swdr::retrieve_image
+	int scene_ranges(const std::string& scene_path, std::vector<AxisRange>& ranges)
+	{
+		using namespace std;
+		namespace fs = std::filesystem;
+
+		vector<string> filelist;
+		if (fs::is_directory(scene_path))
+		{
+			if (glob_filelist(scene_path, ".tif", filelist) != 0) return 1;
+		}
+		else
+		{
+			filelist.push_back(scene_path);
+		}
+
+		for (const auto& in_file : filelist)
+		{
+			arma::fcube data;
+			if (read_3d_geotif(in_file, data) != 0) return 1;
+
+			const arma::uvec idx = arma::find(data.slice(0) == 1);
+			if (idx.n_elem == 0) continue;
+
+			const arma::fvec sza = arma::fmat(data.slice(1) / 100.0)(idx);
+			arma::fvec vza = arma::fmat(data.slice(2) / 100.0)(idx);
+			const arma::fvec los = arma::fmat(data.slice(3) / 100.0)(idx);
+			const arma::fvec dem = arma::fmat(data.slice(4) / 1000.0)(idx);
+
+			// view zenith angle at the top of the atmosphere
+			vza = arma::sin(arma::datum::pi * vza / 180.0) * 6371.0 / 6471.0;
+			vza = 180.0 * arma::asin(vza) / arma::datum::pi;
+
+			ranges[LUT_AXIS_SZA].add(sza.min());
+			ranges[LUT_AXIS_SZA].add(sza.max());
+			ranges[LUT_AXIS_VZA].add(vza.min());
+			ranges[LUT_AXIS_VZA].add(vza.max());
+			ranges[LUT_AXIS_LOS].add(los.min());
+			ranges[LUT_AXIS_LOS].add(los.max());
+			ranges[LUT_AXIS_DEM].add(dem.min());
+			ranges[LUT_AXIS_DEM].add(dem.max());
+			cout << "-> " << in_file << ": " << idx.n_elem << " valid pixels\n";
+		}
+		return 0;
+	}
+
+	// the nodes bracketing [vmin, vmax], at least min_nodes of them
+	arma::uvec range_nodes(const arma::fvec& axis, const AxisRange& range, arma::uword min_nodes)
+	{
+		const arma::uword num = axis.n_elem;
+		arma::uword dw = 0;
+		arma::uword up = num - 1;
+		while (dw + 1 < num && axis(dw + 1) <= range.vmin)
+			dw++;
+		while (up > 0 && axis(up - 1) >= range.vmax)
+			up--;
+		if (up < dw) up = dw;
+
+		while (up - dw + 1 < min_nodes && up - dw + 1 < num)
+		{
+			if (up + 1 < num)
+				up++;
+			else
+				dw--;
+		}
+		return arma::regspace<arma::uvec>(dw, up);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	using namespace std;
+
+	if (argc < 3)
+	{
+		cout << "Usage: " << argv[0] << " <cfg file> <out .swlut> [sza=min:max] [vza=min:max] [los=min:max] [dem=min:max]\n"
+			<< "       [rows=st:ed,st:ed,...] [scenes=<input tif or directory>]\n";
+		return 1;
+	}
+
+	myConfig cfg;
+	if (cfg.read_config(argv[1]) != 0) return 1;
+	const string out_file = argv[2];
+	if (filesystem::path(out_file).extension() != ".swlut")
+	{
+		cout << "[Error] the LUT subset must be a .swlut file: " << out_file << endl;
+		return 1;
+	}
+
+	shared_ptr<const LutStore> lut;
+	if (load_lut_store(cfg, lut) != 0) return 1;
+
+	vector<AxisRange> ranges(LUT_AXIS_NUM);
+	string scene_path;
+	arma::uvec rows = arma::regspace<arma::uvec>(0, lut->block_rows() - 1);
+	for (int ia = 3; ia < argc; ia++)
+	{
+		vector<string> pack;
+		const string arg = argv[ia];
+		boost::split(pack, arg, boost::is_any_of("="));
+		if (pack.size() != 2)
+		{
+			cout << "[Error] arguments are key=value: " << arg << endl;
+			return 1;
+		}
+
+		string key = pack[0];
+		boost::algorithm::to_lower(key);
+		int flag = 0;
+		if (key == "sza")
+			flag = parse_range(pack[1], ranges[LUT_AXIS_SZA]);
+		else if (key == "vza")
+			flag = parse_range(pack[1], ranges[LUT_AXIS_VZA]);
+		else if (key == "los")
+			flag = parse_range(pack[1], ranges[LUT_AXIS_LOS]);
+		else if (key == "dem")
+			flag = parse_range(pack[1], ranges[LUT_AXIS_DEM]);
+		else if (key == "rows")
+			flag = parse_rows(pack[1], lut->block_rows(), rows);
+		else if (key == "scenes")
+			scene_path = pack[1];
+		else
+		{
+			cout << "[Error] cannot find the correct key: " << key << endl;
+			return 1;
+		}
+		if (flag != 0) return 1;
+	}
+
+	vector<AxisRange> scene(LUT_AXIS_NUM);
+	if (scene_path.length() > 0)
+	{
+		if (scene_ranges(scene_path, scene) != 0) return 1;
+	}
+
+	//-------------------------------------------------------------
+	// the retrieval interpolates between two SZA, VZA and DEM nodes
+	const char* const names[LUT_AXIS_NUM] = { "SZA", "VZA", "LOS", "DEM" };
+	const arma::uword min_nodes[LUT_AXIS_NUM] = { 2, 2, 1, 2 };
+	vector<arma::uvec> nodes(LUT_AXIS_NUM);
+	cout << "\nLUT subset\n";
+	cout << "--------------------------------------------------\n";
+	for (int ia = 0; ia < LUT_AXIS_NUM; ia++)
+	{
+		const LutAxis axis = static_cast<LutAxis>(ia);
+		const arma::fvec& values = lut->axis_values(axis);
+
+		AxisRange range = ranges[ia];
+		if (!range.given && scene[ia].vmin <= scene[ia].vmax) range = scene[ia];
+		if (range.vmin <= range.vmax)
+			nodes[ia] = range_nodes(values, range, min_nodes[ia]);
+		else
+			nodes[ia] = arma::regspace<arma::uvec>(0, values.n_elem - 1);
+
+		cout << names[ia] << " nodes    : ";
+		for (const auto& in : nodes[ia])
+			cout << values(in) << ", ";
+		cout << "(" << nodes[ia].n_elem << " of " << values.n_elem << ")\n";
+	}
+	cout << "Block rows   : " << rows.n_elem << " of " << lut->block_rows() << endl;
+
+	if (lut->write_subset(nodes, rows, out_file) != 0) return 1;
+
+	arma::uword out_rows = rows.n_elem;
+	for (const auto& item : nodes)
+		out_rows *= item.n_elem;
+	cout << "Save the LUT subset to " << out_file << " (" << 100.0 * out_rows / lut->n_rows() << " % of the LUT)\n";
+	cout << "Set lut_file = " << out_file << " in the config file to use it.\n";
+
+	return 0;
+}